@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "binary.h"
+#include "decode.h"
+
+#define N_REGISTERS		(1 << 20)
+#define N_PASSES		20
+#define N_PACKETS		(1 << 20)
+
+//the original bit-loop decoder, kept here as the reference for comparison
+static float legacyBit32ToFloat(uint32_t bit32)
+{
+	int sign = 1;
+	float fraction = 1;	
+	int exponent = -127;		
+	
+	if (bit32 & (uint32_t)(1u << 31))
+	{
+		sign = -1;
+	}
+	
+	for (int i = 1; i < 24; i++)
+	{
+		if (bit32 & (uint32_t)(1 << (23 - i)))
+		{
+			fraction += pow(2, -i);
+		}
+	}
+	
+	for (int i = 0; i < 8; i++)
+	{
+		if (bit32 & (uint32_t)(1 << (23 + i)))
+		{
+			exponent += pow(2, i);
+		}
+	}		
+	
+	return sign*fraction*pow(2, exponent);
+}
+
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+static void report(const char* name, double seconds, int passes)
+{
+	double values = (double)N_REGISTERS*passes;
+	
+	printf("%-10s %8.2f ns/value %10.1f MB/s\n", name, seconds*1e9/values, values*4/seconds/1e6);
+}
+
+
+//batch packets the UM7 broadcasts, decoded as the reader does
+static void benchPackets(const uint8_t* data)
+{
+	static const struct
+	{
+	  const char* name;
+	  uint8_t address;
+	  int n_registers;
+	} packets[] = {{"all_proc", DREG_ALL_PROC, 12}, {"quat+euler", DREG_QUAT_AB, 8}, {"nav+gps", DREG_POSITION_N, 14}};
+	imu_state state;
+	uint32_t updated = 0;
+	
+	memset(&state, 0, sizeof(imu_state));
+	
+	for (int p = 0; p < (int)(sizeof(packets)/sizeof(packets[0])); p++)
+	{
+		double start = now();
+		
+		for (int i = 0; i < N_PACKETS; i++)
+		{
+			updated |= decodeRegisters(packets[p].address, &data[4*(i & 1023)*packets[p].n_registers], packets[p].n_registers, &state);
+		}
+		
+		double seconds = now() - start;
+		
+		printf("%-10s %8.2f ns/packet %9.2f ns/register\n", packets[p].name, seconds*1e9/N_PACKETS, seconds*1e9/N_PACKETS/packets[p].n_registers);
+	}
+	
+	if (!(updated & DECODED_GPS) || state.gyro.x == 0)
+	{
+		printf("packet decode did nothing\n");
+	}
+}
+
+
+int main(void)
+{
+	uint8_t* data = malloc(4*N_REGISTERS);
+	float* out = malloc(sizeof(float)*N_REGISTERS);
+	float* expected = malloc(sizeof(float)*N_REGISTERS);
+	volatile float sink = 0;
+	
+	//big-endian registers holding typical sensor magnitudes
+	srand(1);
+	
+	for (int i = 0; i < N_REGISTERS; i++)
+	{
+		expected[i] = (rand() - RAND_MAX/2)/(float)(1 << (rand() % 24));
+		
+		uint32_t bits;
+		memcpy(&bits, &expected[i], 4);
+		data[4*i + 0] = bits >> 24;
+		data[4*i + 1] = bits >> 16;
+		data[4*i + 2] = bits >> 8;
+		data[4*i + 3] = bits;
+	}
+	
+	printf("bench_binary: %i big-endian registers\n", N_REGISTERS);
+	
+	double start = now();
+	
+	for (int i = 0; i < N_REGISTERS; i++)
+	{
+		sink += legacyBit32ToFloat(bit8ArrayToBit32(&data[4*i]));
+	}
+	
+	report("legacy", now() - start, 1);
+	
+	start = now();
+	
+	for (int pass = 0; pass < N_PASSES; pass++)
+	{
+		for (int i = 0; i < N_REGISTERS; i++)
+		{
+			out[i] = bit8ArrayToFloat(&data[4*i]);
+		}
+		
+		sink += out[pass];
+	}
+	
+	report("scalar", now() - start, N_PASSES);
+	
+	start = now();
+	
+	for (int pass = 0; pass < N_PASSES; pass++)
+	{
+		bit8ArrayToFloats(data, out, N_REGISTERS);
+		sink += out[pass];
+	}
+	
+	report("batch", now() - start, N_PASSES);
+	
+	if (memcmp(out, expected, sizeof(float)*N_REGISTERS))
+	{
+		printf("batch decode mismatch\n");
+		return EXIT_FAILURE;
+	}
+	
+	benchPackets(data);
+	
+	//special values the legacy decoder got wrong
+	uint8_t specials[4][4] = {{0x00, 0x00, 0x00, 0x01}, {0x7F, 0x80, 0x00, 0x00}, {0xFF, 0x80, 0x00, 0x00}, {0x7F, 0xC0, 0x00, 0x00}};
+	
+	if (bit8ArrayToFloat(specials[0]) <= 0 || !isinf(bit8ArrayToFloat(specials[1])) || bit8ArrayToFloat(specials[2]) > 0 || !isnan(bit8ArrayToFloat(specials[3])))
+	{
+		printf("special value mismatch\n");
+		return EXIT_FAILURE;
+	}
+	
+	free(data);
+	free(out);
+	free(expected);
+	
+	return EXIT_SUCCESS;
+}
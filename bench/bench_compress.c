@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "um7.h"
+#include "log.h"
+#include "logread.h"
+
+#define PLAIN_PATH			"/tmp/bench_compress.log"
+#define PACKED_PATH			"/tmp/bench_compress.lz"
+
+//the broadcast groups of a busy UM7 at the highest rates it offers
+typedef struct
+{
+  uint8_t address;
+  int count;
+  double rate;
+} group;
+
+static const group groups[] =
+{
+	{DREG_ALL_PROC, 		12, 255},
+	{DREG_QUAT_AB, 			3, 	255},
+	{DREG_EULER_PHI_THETA, 	5, 	255},
+	{DREG_POSITION_N, 		4, 	5},
+	{DREG_VELOCITY_N, 		4, 	5},
+	{DREG_GPS_LATITUDE, 	6, 	5},
+	{DREG_TEMPERATURE, 		2, 	1},
+	{DREG_HEALTH, 			1, 	1},
+};
+
+#define N_GROUPS			(sizeof(groups)/sizeof(groups[0]))
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+static void putFloat(uint8_t* data, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(uint32_t));
+	
+	data[0] = bits >> 24;
+	data[1] = bits >> 16;
+	data[2] = bits >> 8;
+	data[3] = bits;
+}
+
+
+//slow motion plus sensor noise, the last register of a group is its time
+static void fill(packet* p, const group* g, double t)
+{
+	for (int i = 0; i < g->count; i++)
+	{
+		double noise = (rand()/(RAND_MAX + 1.0) - 0.5)*0.02;
+		putFloat(&p->data[4*i], (i == g->count - 1) ? t : sin(0.3*t + i) + noise);
+	}
+	
+	p->address = g->address;
+	p->n_data_bytes = 4*g->count;
+	p->packet_type = PT_HAS_DATA | ((g->count > 1) ? PT_IS_BATCH | (g->count << 2) : 0);
+}
+
+
+//packets of 'seconds' of capture in arrival order
+static packet* generate(double seconds, int* n_packets)
+{
+	double next[N_GROUPS] = {0};
+	int capacity = 1024;
+	packet* packets = malloc(capacity*sizeof(packet));
+	uint64_t start = 1000000000ULL;
+	
+	*n_packets = 0;
+	
+	while (1)
+	{
+		int k = 0;
+		
+		for (int i = 1; i < N_GROUPS; i++)
+		{
+			if (next[i] < next[k])
+			{
+				k = i;
+			}
+		}
+		
+		if (next[k] >= seconds)
+		{
+			break;
+		}
+		
+		if (*n_packets == capacity)
+		{
+			capacity *= 2;
+			packets = realloc(packets, capacity*sizeof(packet));
+		}
+		
+		packet* p = &packets[*n_packets];
+		
+		memset(p, 0, sizeof(packet));
+		fill(p, &groups[k], next[k]);
+		p->sequence = *n_packets;
+		p->timestamp = start + (uint64_t)(next[k]*1e9) + rand() % 200000;
+		
+		(*n_packets)++;
+		next[k] += 1.0/groups[k].rate;
+	}
+	
+	return packets;
+}
+
+
+static double writeCapture(const char* path, int is_packed, const packet* packets, int n_packets, const log_header* header)
+{
+	log_writer log;
+	double start = now();
+	
+	if (!(is_packed ? openPackedLog(&log, path, header) : openLog(&log, path, header)))
+	{
+		fprintf(stderr, "Could not open %s.\n", path);
+		exit(EXIT_FAILURE);
+	}
+	
+	for (int i = 0; i < n_packets; i++)
+	{
+		writeLogPacket(&log, &packets[i]);
+	}
+	
+	closeLog(&log);
+	
+	return now() - start;
+}
+
+
+static uint8_t* readFile(const char* path, long* size)
+{
+	FILE* file = fopen(path, "rb");
+	
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	
+	uint8_t* data = malloc(*size);
+	
+	if (fread(data, 1, *size, file) != *size)
+	{
+		exit(EXIT_FAILURE);
+	}
+	
+	fclose(file);
+	
+	return data;
+}
+
+
+int main(int argc, char *argv[])
+{
+	double seconds = 600;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				seconds = atof(optarg);
+				break;
+			default:
+				printf("usage: bench_compress [-s seconds of capture]\n");
+				return EXIT_FAILURE;
+		}
+	}
+	
+	int n_packets;
+	packet* packets = generate(seconds, &n_packets);
+	log_header header;
+	
+	initLogHeader(&header);
+	
+	double plain_time = writeCapture(PLAIN_PATH, 0, packets, n_packets, &header);
+	double packed_time = writeCapture(PACKED_PATH, 1, packets, n_packets, &header);
+	
+	long plain_size, packed_size;
+	uint8_t* plain = readFile(PLAIN_PATH, &plain_size);
+	uint8_t* packed = readFile(PACKED_PATH, &packed_size);
+	
+	uint8_t* unpacked = NULL;
+	uint32_t corrupt = 0;
+	uint64_t unpacked_size = 0;
+	double unpack_time = INFINITY;
+	
+	for (int pass = 0; pass < 3; pass++)
+	{
+		free(unpacked);
+		
+		double start = now();
+		unpacked_size = unpackLog(packed, packed_size, &unpacked, &corrupt);
+		unpack_time = fmin(unpack_time, now() - start);
+	}
+	
+	//past the header magic and the time of the opening sync record, which 
+	//is when each file was opened, the unpacked log is the plain one
+	long same_from = sizeof(log_header) + LOG_RECORD_OVERHEAD + 8;
+	int is_identical = (unpacked_size == plain_size) && !memcmp(unpacked + 8, plain + 8, sizeof(log_header) - 8) && 
+		!memcmp(unpacked + same_from, plain + same_from, plain_size - same_from);
+	
+	printf("bench_compress: %.0f s of capture at full broadcast rate, %i packets\n", seconds, n_packets);
+	printf("plain        %10ld bytes  %8.1f ms to write\n", plain_size, plain_time*1e3);
+	printf("packed       %10ld bytes  %8.1f ms to write  %.2fx smaller\n", packed_size, packed_time*1e3, (double)plain_size/packed_size);
+	printf("pack cost    %10.1f ns/packet  %6.3f%% of a core at this rate\n", packed_time*1e9/n_packets, 100*packed_time/seconds);
+	printf("unpack       %10.0f MB/s of plain log  %s, %u damaged blocks\n", unpacked_size/unpack_time*1e-6, is_identical ? "identical" : "DIFFERENT", corrupt);
+	
+	unlink(PLAIN_PATH);
+	unlink(PACKED_PATH);
+	unlink(PLAIN_PATH ".idx");
+	unlink(PACKED_PATH ".idx");
+	
+	return is_identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "um7.h"
+#include "parser.h"
+
+#define MAX_CHUNK			4096	//UART_BYTE_BUFFER, the largest single read
+#define N_PASSES			3
+
+typedef struct
+{
+  uint8_t* bytes;
+  uint32_t length;
+  uint32_t packets;					//intact packets in the stream
+  uint32_t all_proc_packets;		//intact DREG_ALL_PROC packets in the stream
+} stream;
+
+//register groups a busy UM7 broadcasts, single registers and batches
+static const uint8_t group_address[] = {DREG_HEALTH, DREG_ALL_PROC, DREG_QUAT_AB, DREG_EULER_PHI_THETA, DREG_POSITION_N, DREG_VELOCITY_N, DREG_GPS_LATITUDE, DREG_TEMPERATURE};
+static const uint8_t group_count[] = {1, 12, 3, 5, 4, 4, 6, 2};
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+static double chance(void)
+{
+	return rand()/(RAND_MAX + 1.0);
+}
+
+
+//builds a stream of 'length' bytes, 'garbage' is the fraction of bytes that
+//are noise between packets and 'corruption' the fraction of damaged packets
+static void generate(stream* s, uint32_t length, double garbage, double corruption)
+{
+	s->bytes = malloc(length + MAX_PACKET_LENGTH);
+	s->length = 0;
+	s->packets = 0;
+	s->all_proc_packets = 0;
+
+	while (s->length < length)
+	{
+		if (chance() < garbage)
+		{
+			//noise, now and then with a false 'snp' header in it
+			int n = 1 + rand() % 16;
+
+			for (int i = 0; i < n; i++)
+			{
+				s->bytes[s->length++] = rand();
+			}
+
+			if (chance() < 0.1)
+			{
+				memcpy(&s->bytes[s->length], "snp", 3);
+				s->length += 3;
+			}
+
+			continue;
+		}
+
+		packet p;
+		int group = rand() % sizeof(group_address);
+
+		p.address = group_address[group];
+		p.packet_type = PT_HAS_DATA | ((group_count[group] > 1) ? PT_IS_BATCH | (group_count[group] << 2) : 0);
+		p.n_data_bytes = 4*group_count[group];
+
+		for (int i = 0; i < p.n_data_bytes; i++)
+		{
+			p.data[i] = rand();
+		}
+
+		int n = encodePacket(&p, &s->bytes[s->length]);
+
+		if (chance() < corruption)
+		{
+			s->bytes[s->length + rand() % n] ^= 1 << (rand() % 8);
+		}
+		else
+		{
+			s->packets++;
+			s->all_proc_packets += (p.address == DREG_ALL_PROC);
+		}
+
+		s->length += n;
+	}
+}
+
+
+static void report(const char* name, int chunk, const stream* s, uint32_t recovered, uint32_t expected, double seconds)
+{
+	printf("%-10s %5i %12.0f %10.1f %10.1f %9.4f\n", name, chunk, recovered/seconds, s->length/seconds/1e6, seconds*1e9/(recovered ? recovered : 1), (double)recovered/expected);
+}
+
+
+//the streaming ring-buffer parser as driven by the reader thread and rxPacket
+static void benchStreaming(const stream* s, int chunk)
+{
+	parser* p = malloc(sizeof(parser));
+	packet rx_packet;
+	uint32_t recovered = 0;
+
+	double start = now();
+
+	for (int pass = 0; pass < N_PASSES; pass++)
+	{
+		initParser(p);
+		recovered = 0;
+
+		for (uint32_t offset = 0; offset < s->length; offset += chunk)
+		{
+			uint32_t n = (s->length - offset < chunk) ? s->length - offset : chunk;
+			parserPush(p, &s->bytes[offset], n);
+
+			while (parserNext(p, &rx_packet))
+			{
+				recovered++;
+			}
+		}
+	}
+
+	report("streaming", chunk, s, recovered, s->packets, (now() - start)/N_PASSES);
+	free(p);
+}
+
+
+//the original parser called once per read looking for DREG_ALL_PROC, as the
+//old rxPacket did. Its length argument is 8 bits wide, so the sweep stops at
+//255-byte reads, anything longer was silently truncated.
+static void benchLegacy(const stream* s, int chunk)
+{
+	packet rx_packet;
+	uint32_t recovered = 0;
+
+	double start = now();
+
+	for (int pass = 0; pass < N_PASSES; pass++)
+	{
+		recovered = 0;
+
+		for (uint32_t offset = 0; offset < s->length; offset += chunk)
+		{
+			uint32_t n = (s->length - offset < chunk) ? s->length - offset : chunk;
+			recovered += parseUART(DREG_ALL_PROC, &s->bytes[offset], n, &rx_packet);
+		}
+	}
+
+	report("legacy", chunk, s, recovered, s->all_proc_packets, (now() - start)/N_PASSES);
+}
+
+
+int main(int argc, char *argv[])
+{
+	double garbage = 0.05;
+	double corruption = 0.01;
+	double megabytes = 8;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:c:m:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'g':
+				garbage = atof(optarg);
+				break;
+			case 'c':
+				corruption = atof(optarg);
+				break;
+			case 'm':
+				megabytes = atof(optarg);
+				break;
+			default:
+				printf("usage: bench_parser [-g garbage fraction] [-c corrupt packet fraction] [-m stream MB]\n");
+				return EXIT_FAILURE;
+		}
+	}
+
+	stream s;
+
+	srand(1);
+	generate(&s, megabytes*1e6, garbage, corruption);
+
+	printf("bench_parser: %.1f MB stream, %u packets, %.0f%% garbage, %.1f%% corrupt\n", s.length/1e6, s.packets, garbage*100, corruption*100);
+	printf("%-10s %5s %12s %10s %10s %9s\n", "parser", "chunk", "packets/s", "MB/s", "ns/packet", "recovered");
+
+	for (int chunk = 16; chunk <= MAX_CHUNK; chunk *= 4)
+	{
+		benchStreaming(&s, chunk);
+	}
+
+	for (int chunk = 16; chunk <= 255; chunk *= 4)
+	{
+		benchLegacy(&s, chunk);
+	}
+	
+	benchLegacy(&s, 255);
+
+	free(s.bytes);
+
+	return EXIT_SUCCESS;
+}
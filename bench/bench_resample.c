@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "resample.h"
+
+#define SAMPLE_RATE		200		//Hz of every group, about the UM7's fastest broadcast
+#define TRIGGERS		(1 << 16)
+
+static resampler r;
+static resampled_state out[TRIGGERS];
+static uint64_t times[TRIGGERS];
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+static void randomQuat(double q[4])
+{
+	double norm = 0;
+
+	for (int c = 0; c < 4; c++)
+	{
+		q[c] = rand()/(double)RAND_MAX - 0.5;
+		norm += q[c]*q[c];
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		q[c] /= sqrt(norm);
+	}
+}
+
+
+//the polynomial slerp against acos and sin in double, over random pairs
+//whose angle is at most 'angle' radians apart
+static double slerpError(double angle)
+{
+	static float a[4][RESAMPLE_BATCH], b[4][RESAMPLE_BATCH], q[4][RESAMPLE_BATCH], u[RESAMPLE_BATCH];
+	double exact[4][RESAMPLE_BATCH];
+	double worst = 0;
+
+	for (int pass = 0; pass < 100; pass++)
+	{
+		for (int j = 0; j < RESAMPLE_BATCH; j++)
+		{
+			double p[4], axis[4], s[4];
+
+			randomQuat(p);
+			randomQuat(axis);
+
+			//rotate p towards a random direction orthogonal to it
+			double dot = p[0]*axis[0] + p[1]*axis[1] + p[2]*axis[2] + p[3]*axis[3], norm = 0;
+
+			for (int c = 0; c < 4; c++)
+			{
+				axis[c] -= dot*p[c];
+				norm += axis[c]*axis[c];
+			}
+
+			double theta = angle*rand()/RAND_MAX;
+			double t = rand()/(double)RAND_MAX;
+
+			for (int c = 0; c < 4; c++)
+			{
+				axis[c] /= sqrt(norm);
+				s[c] = cos(theta)*p[c] + sin(theta)*axis[c];
+				a[c][j] = p[c];
+				b[c][j] = s[c];
+				exact[c][j] = (theta > 0) ? (sin((1 - t)*theta)*p[c] + sin(t*theta)*s[c])/sin(theta) : p[c];
+			}
+
+			u[j] = t;
+		}
+
+		slerpKernel(q, a, b, u);
+
+		for (int j = 0; j < RESAMPLE_BATCH; j++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				worst = fmax(worst, fabs(q[c][j] - exact[c][j]));
+			}
+		}
+	}
+
+	return worst;
+}
+
+
+//samples streamed through the bounded history until every trigger is due,
+//each answered as soon as samples pass it, as the live stage does
+static void run(const char* name, int mode, double trigger_hz)
+{
+	imu_state state;
+	uint64_t sample_period = 1000000000ULL/SAMPLE_RATE;
+	uint64_t trigger_period = 1e9/trigger_hz;
+	int n_triggers = 0, next = 0, valid = 0;
+	double busy = 0;
+
+	memset(&state, 0, sizeof(imu_state));
+	initResampler(&r, mode);
+
+	for (int i = 0; n_triggers < TRIGGERS; i++)
+	{
+		uint64_t t = 1000000000ULL + i*sample_period;
+		double phase = i*0.01;
+
+		state.quat.a = cos(phase/2);
+		state.quat.b = sin(phase/2);
+		state.euler.roll_rate = state.gyro.x = sin(phase);
+		state.position.x = state.velocity.x = phase;
+		state.quat.stamp.aligned = state.euler.stamp.aligned = state.gyro.stamp.aligned = t;
+		state.position.stamp.aligned = state.velocity.stamp.aligned = t;
+
+		double start = now();
+
+		addResampleSamples(&r, &state, DECODED_QUAT | DECODED_EULER | DECODED_GYRO | DECODED_POSITION | DECODED_VELOCITY);
+
+		while (n_triggers < TRIGGERS && 1000000000ULL + n_triggers*trigger_period < t)
+		{
+			times[n_triggers] = 1000000000ULL + n_triggers*trigger_period;
+			n_triggers++;
+		}
+
+		while (next < n_triggers && isResampleReady(&r, times[next]))
+		{
+			int n = 0;
+
+			while (next + n < n_triggers && n < RESAMPLE_BATCH && isResampleReady(&r, times[next + n]))
+			{
+				n++;
+			}
+
+			resample(&r, &times[next], n, &out[next]);
+			next += n;
+		}
+
+		busy += now() - start;
+	}
+
+	for (int i = 0; i < next; i++)
+	{
+		valid += (out[i].valid & DECODED_QUAT) != 0;
+	}
+
+	printf("%-8s %10.0f %12.1f %14.0f %8i\n", name, trigger_hz, busy*1e9/next, next/busy, valid);
+}
+
+
+int main(int argc, char *argv[])
+{
+	srand(1);
+
+	printf("bench_resample: %i Hz samples, %i triggers per run\n", SAMPLE_RATE, TRIGGERS);
+	printf("slerp max error: %.2e (10 deg), %.2e (45 deg), %.2e (90 deg apart)\n", slerpError(M_PI/18), slerpError(M_PI/4), slerpError(M_PI/2));
+	printf("%-8s %10s %12s %14s %8s\n", "mode", "trigger Hz", "ns/trigger", "triggers/s", "valid");
+
+	for (double hz = 1000; hz <= 10000; hz *= 10)
+	{
+		run("linear", RESAMPLE_LINEAR, hz);
+		run("cubic", RESAMPLE_CUBIC, hz);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "um7.h"
+#include "scan.h"
+
+#define STREAM_LENGTH		(1 << 22)
+#define HEADER_EVERY		4096	//bytes of garbage between real headers
+#define SUM_CALLS			(1 << 20)
+
+typedef uint32_t (*find_function)(const uint8_t*, uint32_t);
+typedef uint16_t (*sum_function)(const uint8_t*, uint32_t);
+
+static uint8_t stream[STREAM_LENGTH];
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+//garbage a lost sync has to get through, a header planted every
+//HEADER_EVERY bytes so each search ends somewhere
+static void generate(const char* kind)
+{
+	//text off a misconfigured port, 's' and 'sn' turn up often
+	static const char text[] = "$GPGSV,3,1,snsnp,sss,status nsp snap 12.5 ";
+
+	for (uint32_t i = 0; i < STREAM_LENGTH; i++)
+	{
+		if (!strcmp(kind, "random"))
+		{
+			stream[i] = rand();
+		}
+		else if (!strcmp(kind, "text"))
+		{
+			stream[i] = text[rand() % (sizeof(text) - 1)];
+		}
+		else
+		{
+			stream[i] = 's';
+		}
+	}
+
+	for (uint32_t i = HEADER_EVERY; i + 3 < STREAM_LENGTH; i += HEADER_EVERY)
+	{
+		memcpy(&stream[i], "snp", 3);
+	}
+}
+
+
+//every header in the stream the way a parser walks it, resuming on the
+//byte after each one found
+static double findAll(find_function find, uint32_t* found)
+{
+	double start = now();
+	uint32_t offset = 0;
+
+	*found = 0;
+
+	while (offset + 3 <= STREAM_LENGTH)
+	{
+		offset += find(&stream[offset], STREAM_LENGTH - offset);
+
+		if (offset + 3 > STREAM_LENGTH || memcmp(&stream[offset], "snp", 3))
+		{
+			break;
+		}
+
+		(*found)++;
+		offset++;
+	}
+
+	return now() - start;
+}
+
+
+static void benchFind(const char* kind)
+{
+	static const struct
+	{
+	  const char* name;
+	  find_function find;
+	} variants[] = {{"scalar", findHeaderScalar}, {"memchr", findHeaderMemchr}, {SCAN_VECTOR, findHeader}};
+	uint32_t expected = 0;
+	double scalar = 0;
+
+	generate(kind);
+
+	for (int v = 0; v < (int)(sizeof(variants)/sizeof(variants[0])); v++)
+	{
+		uint32_t found;
+		double best = 1e9;
+
+		for (int pass = 0; pass < 5; pass++)
+		{
+			double t = findAll(variants[v].find, &found);
+			best = (t < best) ? t : best;
+		}
+
+		if (v == 0)
+		{
+			expected = found;
+			scalar = best;
+		}
+
+		printf("%-8s %-8s %10.0f %10.2f %8u %s\n", kind, variants[v].name, STREAM_LENGTH/best/1e6, scalar/best, found, (found == expected) ? "" : "MISMATCH");
+	}
+}
+
+
+static void benchSum(uint32_t length)
+{
+	static uint8_t payload[SUM_CALLS/16][64];
+	uint32_t n_payloads = sizeof(payload)/sizeof(payload[0]);
+	uint16_t sums[2] = {0, 0};
+	double times[2];
+	sum_function sum[2] = {sumBytesScalar, sumBytes};
+
+	for (uint32_t i = 0; i < n_payloads; i++)
+	{
+		for (uint32_t k = 0; k < length; k++)
+		{
+			payload[i][k] = rand();
+		}
+	}
+
+	for (int v = 0; v < 2; v++)
+	{
+		double start = now();
+
+		for (uint32_t i = 0; i < SUM_CALLS; i++)
+		{
+			sums[v] += sum[v](payload[i % n_payloads], length);
+		}
+
+		times[v] = now() - start;
+	}
+
+	printf("%8u %12.1f %12.1f %10.2f %s\n", length, times[0]*1e9/SUM_CALLS, times[1]*1e9/SUM_CALLS, times[0]/times[1], (sums[0] == sums[1]) ? "" : "MISMATCH");
+}
+
+
+int main(int argc, char *argv[])
+{
+	srand(1);
+
+	printf("bench_scan: %i byte streams, a header every %i bytes, %s backend\n", STREAM_LENGTH, HEADER_EVERY, SCAN_VECTOR);
+	printf("%-8s %-8s %10s %10s %8s\n", "garbage", "search", "MB/s", "speedup", "headers");
+
+	benchFind("random");
+	benchFind("text");
+	benchFind("sss");
+
+	printf("\n%8s %12s %12s %10s\n", "payload", "scalar ns", "vector ns", "speedup");
+
+	//one register, a batch of three, of seven and the largest batch
+	benchSum(4);
+	benchSum(12);
+	benchSum(28);
+	benchSum(MAX_PACKET_DATA);
+
+	return EXIT_SUCCESS;
+}
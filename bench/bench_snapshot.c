@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "snapshot.h"
+
+#define MAX_READERS		8
+
+typedef struct
+{
+  uint64_t reads;
+  uint64_t torn;
+  double seconds;
+} reader_result;
+
+static snapshot_lock lock;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static imu_state shared_state;
+static uint64_t shared_timestamp;
+static volatile int is_running;
+static int is_mutex;
+static int publish_interval_us;
+static uint64_t publishes;
+static double publish_max;
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+
+//every field of a published state carries the same counter, a copy mixing
+//two publishes shows up as fields that disagree
+static void fill(imu_state* state, uint64_t counter)
+{
+	float value = counter;
+
+	state->quat.a = state->quat.b = state->quat.c = state->quat.d = value;
+	state->euler.roll = state->euler.pitch = state->euler.yaw = value;
+	state->euler.roll_rate = state->euler.pitch_rate = state->euler.yaw_rate = value;
+	state->position.x = state->position.y = state->position.z = value;
+	state->velocity.x = state->velocity.y = state->velocity.z = value;
+}
+
+
+static int isTorn(const imu_state* state)
+{
+	float value = state->quat.a;
+
+	return state->quat.d != value || state->euler.roll != value || state->euler.yaw_rate != value ||
+		state->position.z != value || state->velocity.x != value || state->velocity.z != value;
+}
+
+
+static void* writer(void* arg)
+{
+	imu_state state;
+	uint64_t counter = 0;
+
+	memset(&state, 0, sizeof(imu_state));
+
+	while (is_running)
+	{
+		fill(&state, ++counter);
+
+		double start = now();
+
+		if (is_mutex)
+		{
+			pthread_mutex_lock(&mutex);
+			shared_state = state;
+			shared_timestamp = counter;
+			pthread_mutex_unlock(&mutex);
+		}
+		else
+		{
+			publishSnapshot(&lock, &state, counter);
+		}
+
+		//the acquisition thread's cost: a mutex makes it wait for readers
+		double publish = now() - start;
+
+		if (publish > publish_max)
+		{
+			publish_max = publish;
+		}
+
+		publishes++;
+
+		if (publish_interval_us)
+		{
+			usleep(publish_interval_us);
+		}
+	}
+
+	return NULL;
+}
+
+
+static void* reader(void* arg)
+{
+	reader_result* result = arg;
+	imu_snapshot snapshot;
+	double start = now();
+
+	while (is_running)
+	{
+		if (is_mutex)
+		{
+			pthread_mutex_lock(&mutex);
+			snapshot.state = shared_state;
+			snapshot.timestamp = shared_timestamp;
+			pthread_mutex_unlock(&mutex);
+		}
+		else
+		{
+			readSnapshot(&lock, &snapshot);
+		}
+
+		result->torn += isTorn(&snapshot.state);
+		result->reads++;
+	}
+
+	result->seconds = now() - start;
+
+	return NULL;
+}
+
+
+static void run(const char* name, int n_readers, int mutex, int interval_us, double seconds)
+{
+	pthread_t writer_thread;
+	pthread_t reader_threads[MAX_READERS];
+	reader_result results[MAX_READERS];
+
+	memset(results, 0, sizeof(results));
+	initSnapshot(&lock);
+	is_mutex = mutex;
+	publish_interval_us = interval_us;
+	is_running = 1;
+	publishes = 0;
+	publish_max = 0;
+
+	pthread_create(&writer_thread, NULL, writer, NULL);
+
+	for (int i = 0; i < n_readers; i++)
+	{
+		pthread_create(&reader_threads[i], NULL, reader, &results[i]);
+	}
+
+	usleep(seconds*1e6);
+	is_running = 0;
+
+	pthread_join(writer_thread, NULL);
+
+	uint64_t reads = 0, torn = 0;
+	double busy = 0;
+
+	for (int i = 0; i < n_readers; i++)
+	{
+		pthread_join(reader_threads[i], NULL);
+		reads += results[i].reads;
+		torn += results[i].torn;
+		busy += results[i].seconds;
+	}
+
+	printf("%-9s %7i %11i %10.1f %12.0f %6llu %10llu %13.1f\n", name, n_readers, interval_us, busy*1e9/reads, reads/(busy/n_readers), 
+		(unsigned long long)torn, (unsigned long long)publishes, publish_max*1e6);
+}
+
+
+int main(int argc, char *argv[])
+{
+	double seconds = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				seconds = atof(optarg);
+				break;
+			default:
+				printf("usage: bench_snapshot [-s seconds per run]\n");
+				return EXIT_FAILURE;
+		}
+	}
+
+	printf("bench_snapshot: %zu byte snapshot, %.1f s per run\n", sizeof(imu_snapshot), seconds);
+	printf("%-9s %7s %11s %10s %12s %6s %10s %13s\n", "sync", "readers", "publish us", "ns/read", "reads/s", "torn", "publishes", "max publish us");
+
+	//a publish per read at 1 kHz as in acquisition, then a writer flat out
+	for (int interval = 1000; interval >= 0; interval -= 1000)
+	{
+		for (int readers = 1; readers <= 2; readers++)
+		{
+			run("seqlock", readers, 0, interval, seconds);
+			run("mutex", readers, 1, interval, seconds);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
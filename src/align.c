@@ -0,0 +1,175 @@
+#include "align.h"
+
+//sample groups that carry a device time register and where it lives
+static const struct
+{
+  uint32_t group;
+  size_t time;
+  size_t stamp;
+} timed_groups[] =
+{
+	{DECODED_GYRO, 			offsetof(imu_state, gyro.time), 		offsetof(imu_state, gyro.stamp)},
+	{DECODED_ACCEL, 		offsetof(imu_state, accel.time), 		offsetof(imu_state, accel.stamp)},
+	{DECODED_MAG, 			offsetof(imu_state, mag.time), 			offsetof(imu_state, mag.stamp)},
+	{DECODED_QUAT, 			offsetof(imu_state, quat.time), 		offsetof(imu_state, quat.stamp)},
+	{DECODED_EULER, 		offsetof(imu_state, euler.time), 		offsetof(imu_state, euler.stamp)},
+	{DECODED_POSITION, 		offsetof(imu_state, position.time), 	offsetof(imu_state, position.stamp)},
+	{DECODED_VELOCITY, 		offsetof(imu_state, velocity.time), 	offsetof(imu_state, velocity.stamp)},
+	{DECODED_GPS, 			offsetof(imu_state, gps.time), 			offsetof(imu_state, gps.stamp)},
+	{DECODED_TEMPERATURE, 	offsetof(imu_state, temperature_time), 	offsetof(imu_state, temperature_stamp)},
+};
+
+void initClockAlign(clock_align* align)
+{
+	memset(align, 0, sizeof(clock_align));
+}
+
+
+//least squares line through the envelope points, then lowered onto the
+//lowest of them: every point sits on or above the true line, so the mean
+//of the points would carry the average USB delay into every timestamp
+static void fitEnvelope(clock_align* align)
+{
+	int n = align->n_buckets;
+	int oldest = (align->next_bucket - n + ALIGN_BUCKETS) % ALIGN_BUCKETS;
+	double mean_x = 0, mean_y = 0, sxx = 0, sxy = 0;
+
+	align->reference = align->device[oldest];
+
+	for (int i = 0; i < n; i++)
+	{
+		int k = (oldest + i) % ALIGN_BUCKETS;
+		mean_x += align->device[k] - align->reference;
+		mean_y += align->difference[k];
+	}
+
+	mean_x /= n;
+	mean_y /= n;
+
+	for (int i = 0; i < n; i++)
+	{
+		int k = (oldest + i) % ALIGN_BUCKETS;
+		double x = align->device[k] - align->reference - mean_x;
+
+		sxx += x*x;
+		sxy += x*(align->difference[k] - mean_y);
+	}
+
+	align->drift = (sxx > 0) ? sxy/sxx : 0;
+	align->offset = mean_y - align->drift*mean_x;
+
+	double lowest = INFINITY, highest = -INFINITY;
+
+	for (int i = 0; i < n; i++)
+	{
+		int k = (oldest + i) % ALIGN_BUCKETS;
+		double residual = align->difference[k] - align->offset - align->drift*(align->device[k] - align->reference);
+
+		lowest = fmin(lowest, residual);
+		highest = fmax(highest, residual);
+	}
+
+	align->offset += lowest;
+	align->jitter = highest - lowest;
+	align->is_locked = (n >= ALIGN_MIN_BUCKETS);
+}
+
+
+static void closeBucket(clock_align* align)
+{
+	align->device[align->next_bucket] = align->bucket_device;
+	align->difference[align->next_bucket] = align->bucket_difference;
+	align->next_bucket = (align->next_bucket + 1) % ALIGN_BUCKETS;
+
+	if (align->n_buckets < ALIGN_BUCKETS)
+	{
+		align->n_buckets++;
+	}
+
+	align->bucket_samples = 0;
+	fitEnvelope(align);
+}
+
+
+//one device time register and the host time of the packet that carried it
+void addClockSample(clock_align* align, float device_time, uint64_t host_time)
+{
+	double device = device_time;
+
+	//device time running backwards means the UM7 restarted, start over
+	if (align->samples && device < align->last_device - ALIGN_MAX_STEP)
+	{
+		uint32_t resets = align->resets + 1;
+
+		initClockAlign(align);
+		align->resets = resets;
+	}
+
+	if (align->samples == 0)
+	{
+		align->host_origin = host_time;
+		align->bucket_start = device;
+	}
+
+	double difference = (int64_t)(host_time - align->host_origin)*1e-9 - device;
+
+	if (align->bucket_samples && device - align->bucket_start >= ALIGN_BUCKET_SECONDS)
+	{
+		closeBucket(align);
+		align->bucket_start = device;
+	}
+
+	if (align->bucket_samples == 0 || difference < align->bucket_difference)
+	{
+		align->bucket_device = device;
+		align->bucket_difference = difference;
+	}
+
+	align->bucket_samples++;
+	align->last_device = device;
+	align->samples++;
+}
+
+
+//host time at which the UM7 took a sample stamped 'device_time', 0 until
+//enough of the envelope has been seen
+uint64_t alignTime(const clock_align* align, float device_time)
+{
+	if (!align->is_locked)
+	{
+		return 0;
+	}
+
+	double device = device_time;
+	double host = device + align->offset + align->drift*(device - align->reference);
+
+	return align->host_origin + (int64_t)llround(host*1e9);
+}
+
+
+//stamps every sample group a packet updated with the host read time and the
+//aligned device time, the first device time in the packet feeds the fit
+void stampSamples(clock_align* align, imu_state* state, uint32_t updated, uint64_t host_time)
+{
+	int is_fed = 0;
+
+	for (int i = 0; i < sizeof(timed_groups)/sizeof(timed_groups[0]); i++)
+	{
+		if (!(updated & timed_groups[i].group))
+		{
+			continue;
+		}
+
+		float device_time = *(float*)((uint8_t*)state + timed_groups[i].time);
+		sample_stamp* stamp = (sample_stamp*)((uint8_t*)state + timed_groups[i].stamp);
+
+		if (!is_fed)
+		{
+			addClockSample(align, device_time, host_time);
+			is_fed = 1;
+		}
+
+		stamp->host = host_time;
+		stamp->aligned = alignTime(align, device_time);
+	}
+}
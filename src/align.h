@@ -0,0 +1,47 @@
+#ifndef ALIGN_H
+#define ALIGN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "decode.h"
+
+#define ALIGN_BUCKET_SECONDS	1.0		//device time covered by one envelope point
+#define ALIGN_BUCKETS			64		//envelope points in the fit, about a minute
+#define ALIGN_MIN_BUCKETS		3		//envelope points before aligned times are given
+#define ALIGN_MAX_STEP			1.0		//seconds of disagreement that mean the UM7 was reset
+
+//online fit of host = device + offset + drift*(device - reference). USB serial
+//adapters only ever delay bytes, so the fit follows the lower envelope of
+//host - device: the smallest difference seen in each bucket of device time.
+typedef struct
+{
+  double device[ALIGN_BUCKETS];			//device time of each envelope point, seconds
+  double difference[ALIGN_BUCKETS];		//smallest host - device in the bucket, seconds
+  int n_buckets;
+  int next_bucket;
+
+  double bucket_start;					//device time the open bucket began
+  double bucket_device;
+  double bucket_difference;
+  int bucket_samples;
+  double last_device;
+
+  uint64_t host_origin;					//host time of the first sample, keeps doubles precise
+  double reference;						//device time the drift is measured from
+  double offset;						//host - device at 'reference', seconds
+  double drift;							//host seconds gained per device second
+  double jitter;						//largest envelope point above the fit, seconds
+  int is_locked;
+  uint64_t samples;
+  uint32_t resets;
+} clock_align;
+
+void initClockAlign(clock_align* align);
+void addClockSample(clock_align* align, float device_time, uint64_t host_time);
+uint64_t alignTime(const clock_align* align, float device_time);
+void stampSamples(clock_align* align, imu_state* state, uint32_t updated, uint64_t host_time);
+
+#endif
@@ -1,37 +1,19 @@
 #include "binary.h"
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 float bit32ToFloat(uint32_t bit32)
 {
 	//https://en.wikipedia.org/wiki/Single-precision_floating-point_format	
+	//the register already holds the IEEE-754 bit pattern, reinterpret it as is
+	//so that denormals, infinities and NaN come through unchanged
+	float singleFloat;
 	
-	int sign = 1;
-	float fraction = 1;	
-	int exponent = -127;		
-	
-	float singleFloat = 0;		
-	
-	if (bit32 & (uint32_t)(1 << 31))
-	{
-		sign = -1;
-	}
-	
-	for (int i = 1; i < 24; i++)
-	{
-		if (bit32 & (uint32_t)(1 << (23 - i)))
-		{
-			fraction += pow(2, -i);
-		}
-	}
-	
-	for (int i = 0; i < 8; i++)
-	{
-		if (bit32 & (uint32_t)(1 << (23 + i)))
-		{
-			exponent += pow(2, i);
-		}
-	}		
-	
-	singleFloat = sign*fraction*pow(2, exponent);
+	memcpy(&singleFloat, &bit32, sizeof(float));
 	
 	return singleFloat;
 }
@@ -39,14 +21,7 @@ float bit32ToFloat(uint32_t bit32)
 
 uint32_t bit8ArrayToBit32(uint8_t *data)
 {
-	uint32_t bit32 = 0;
-	
-	bit32 = (uint32_t)(data[3] << 0);
-	bit32 += (uint32_t)(data[2] << 8);
-	bit32 += (uint32_t)(data[1] << 16);
-	bit32 += (uint32_t)(data[0] << 24);
-	
-	return bit32;
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
 }
 
 
@@ -56,9 +31,39 @@ float bit8ArrayToFloat(uint8_t *data)
 }
 
 
+//converts 'n' consecutive big-endian registers, e.g. a batch packet payload
+//or a chunk of a log, to host floats in one call
+void bit8ArrayToFloats(const uint8_t *data, float *out, int n)
+{
+	int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 4 <= n; i += 4)
+	{
+		uint8x16_t bytes = vrev32q_u8(vld1q_u8(&data[4*i]));
+		vst1q_f32(&out[i], vreinterpretq_f32_u8(bytes));
+	}
+#elif defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+	{
+		//swap the 16-bit halves of each word, then the bytes within each half
+		__m128i words = _mm_loadu_si128((const __m128i*)&data[4*i]);
+		words = _mm_shufflehi_epi16(_mm_shufflelo_epi16(words, 0xB1), 0xB1);
+		words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+		_mm_storeu_ps(&out[i], _mm_castsi128_ps(words));
+	}
+#endif
+
+	for (; i < n; i++)
+	{
+		out[i] = bit32ToFloat(bit8ArrayToBit32((uint8_t*)&data[4*i]));
+	}
+}
+
+
 uint8_t checkBit(uint32_t reg, uint8_t bit)
 {
-	if (reg & (uint32_t)(1 << bit))
+	if (reg & ((uint32_t)1 << bit))
 		return 1;
 	else
 		return 0;
@@ -9,12 +9,14 @@
 #include <errno.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "colour.h"
 
 uint32_t bit8ArrayToBit32(uint8_t *data);
 float bit32ToFloat(uint32_t bit32);
 float bit8ArrayToFloat(uint8_t *data);
+void bit8ArrayToFloats(const uint8_t *data, float *out, int n);
 uint8_t checkBit(uint32_t reg, uint8_t bit);
 
 #endif
@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+
+#include "blockfile.h"
+
+int openBlockFile(block_file* file, const char* path, int is_direct)
+{
+	memset(file, 0, sizeof(block_file));
+	
+	file->fd = -1;
+	file->last_sync = hostTime();
+	
+	if (posix_memalign((void**)&file->buffer, BLOCKFILE_ALIGN, BLOCKFILE_BLOCK_SIZE))
+	{
+		return 0;
+	}
+	
+	if (is_direct)
+	{
+		file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		file->is_direct = (file->fd >= 0);
+		
+		//tmpfs and some FUSE mounts refuse O_DIRECT, the page cache still works
+		if (file->fd < 0 && errno == EINVAL)
+		{
+			fprintf(stderr, "%s: O_DIRECT not supported, writing through the page cache.\n", path);
+		}
+	}
+	
+	if (file->fd < 0)
+	{
+		file->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	
+	if (file->fd < 0)
+	{
+		free(file->buffer);
+		file->buffer = NULL;
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+//keeps the reservation a whole step ahead of the next write, the file size
+//only grows as data is written
+static void reserve(block_file* file, uint64_t end)
+{
+	while (file->allocated < end + BLOCKFILE_BLOCK_SIZE)
+	{
+		if (fallocate(file->fd, FALLOC_FL_KEEP_SIZE, file->allocated, BLOCKFILE_PREALLOCATE) != 0)
+		{
+			//not every filesystem can, writes then allocate as they go
+			file->allocated = UINT64_MAX/2;
+			return;
+		}
+		
+		file->allocated += BLOCKFILE_PREALLOCATE;
+	}
+}
+
+
+static int writeBlock(block_file* file, uint32_t length)
+{
+	uint64_t start = hostTime();
+	
+	reserve(file, file->offset + length);
+	
+	if (pwrite(file->fd, file->buffer, length, file->offset) != length)
+	{
+		return 0;
+	}
+	
+	file->writes++;
+	
+	if (file->write_times)
+	{
+		recordHistogram(file->write_times, hostTime() - start);
+	}
+	
+	return 1;
+}
+
+
+int writeBlockFile(block_file* file, const void* data, uint32_t length)
+{
+	const uint8_t* bytes = data;
+	
+	while (length > 0)
+	{
+		uint32_t n = BLOCKFILE_BLOCK_SIZE - file->used;
+		
+		if (n > length)
+		{
+			n = length;
+		}
+		
+		memcpy(&file->buffer[file->used], bytes, n);
+		file->used += n;
+		file->is_dirty = 1;
+		bytes += n;
+		length -= n;
+		
+		if (file->used == BLOCKFILE_BLOCK_SIZE)
+		{
+			if (!writeBlock(file, BLOCKFILE_BLOCK_SIZE))
+			{
+				return 0;
+			}
+			
+			file->offset += BLOCKFILE_BLOCK_SIZE;
+			file->used = 0;
+		}
+	}
+	
+	return 1;
+}
+
+
+//puts everything written so far on the media, the partial block goes out
+//padded and stays in the buffer to be completed
+int syncBlockFile(block_file* file)
+{
+	if (!file->is_dirty)
+	{
+		return 1;
+	}
+	
+	uint64_t start = hostTime();
+	uint32_t length = file->used;
+	
+	if (file->is_direct)
+	{
+		length = (length + BLOCKFILE_ALIGN - 1) & ~(BLOCKFILE_ALIGN - 1);
+		memset(&file->buffer[file->used], 0, length - file->used);
+	}
+	
+	if (length > 0 && !writeBlock(file, length))
+	{
+		return 0;
+	}
+	
+	if (fdatasync(file->fd) != 0)
+	{
+		return 0;
+	}
+	
+	file->is_dirty = 0;
+	file->syncs++;
+	file->last_sync = hostTime();
+	
+	if (file->sync_times)
+	{
+		recordHistogram(file->sync_times, file->last_sync - start);
+	}
+	
+	return 1;
+}
+
+
+int closeBlockFile(block_file* file)
+{
+	int is_ok = 1;
+	
+	if (file->fd < 0)
+	{
+		return 0;
+	}
+	
+	//the padding of the last block goes
+	is_ok &= syncBlockFile(file);
+	is_ok &= (ftruncate(file->fd, blockFileSize(file)) == 0);
+	is_ok &= (fsync(file->fd) == 0);
+	is_ok &= (close(file->fd) == 0);
+	
+	free(file->buffer);
+	file->buffer = NULL;
+	file->fd = -1;
+	
+	return is_ok;
+}
+
+
+uint64_t blockFileSize(const block_file* file)
+{
+	return file->offset + file->used;
+}
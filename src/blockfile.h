@@ -0,0 +1,47 @@
+#ifndef BLOCKFILE_H
+#define BLOCKFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "histogram.h"
+#include "clock.h"
+
+#define BLOCKFILE_ALIGN			4096				//O_DIRECT alignment of buffers, offsets and lengths
+#define BLOCKFILE_BLOCK_SIZE	(128*1024)			//bytes per write
+#define BLOCKFILE_PREALLOCATE	(16ULL << 20)		//space reserved ahead of the write position
+
+//append-only file written in whole aligned blocks from one buffer. Space is
+//reserved ahead with fallocate so a write never waits on block allocation,
+//and data reaches the media at a fixed sync interval rather than whenever
+//the page cache decides. A sync writes the partial block out padded to the
+//alignment and rewrites it in place once it fills, close trims the padding.
+//When to sync is up to the owner.
+typedef struct
+{
+  int fd;
+  int is_direct;
+  uint8_t* buffer;						//BLOCKFILE_BLOCK_SIZE, aligned
+  uint32_t used;
+  uint64_t offset;						//file offset of buffer[0]
+  uint64_t allocated;					//bytes reserved with fallocate
+  uint64_t last_sync;					//hostTime() of the last sync, or of the open
+  int is_dirty;							//data buffered or written since the last sync
+  uint64_t writes;
+  uint64_t syncs;
+  latency_histogram* write_times;		//ns per block write, NULL if not wanted
+  latency_histogram* sync_times;		//ns per sync, NULL if not wanted
+} block_file;
+
+int openBlockFile(block_file* file, const char* path, int is_direct);
+int writeBlockFile(block_file* file, const void* data, uint32_t length);
+int syncBlockFile(block_file* file);
+int closeBlockFile(block_file* file);
+uint64_t blockFileSize(const block_file* file);
+
+#endif
@@ -0,0 +1,22 @@
+#include "clock.h"
+
+//host monotonic clock in nanoseconds, used to stamp packets as they are read.
+//The raw clock is never slewed by NTP, so intervals between stamps are the 
+//oscillator's own and the UM7 clock fit sees a steady drift.
+uint64_t hostTime(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+	
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
+
+
+//wall clock in nanoseconds since the epoch
+uint64_t wallTime(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	
+	return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+}
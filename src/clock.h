@@ -0,0 +1,10 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t hostTime(void);
+uint64_t wallTime(void);
+
+#endif
@@ -0,0 +1,214 @@
+#include "compress.h"
+
+static uint32_t read32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(uint32_t));
+	return value;
+}
+
+
+static uint32_t hash32(uint32_t value)
+{
+	return (value*2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+
+static uint8_t* putLength(uint8_t* op, uint32_t length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	
+	*op++ = length;
+	
+	return op;
+}
+
+
+static uint8_t* putSequence(uint8_t* op, const uint8_t* literals, uint32_t n_literals, uint32_t offset, uint32_t match)
+{
+	uint8_t* token = op++;
+	uint32_t match_code = match - LZ_MIN_MATCH;
+	
+	*token = ((n_literals < 15) ? n_literals : 15) << 4;
+	
+	if (n_literals >= 15)
+	{
+		op = putLength(op, n_literals - 15);
+	}
+	
+	memcpy(op, literals, n_literals);
+	op += n_literals;
+	
+	//the last sequence is literals only
+	if (match == 0)
+	{
+		return op;
+	}
+	
+	*op++ = offset;
+	*op++ = offset >> 8;
+	*token |= (match_code < 15) ? match_code : 15;
+	
+	if (match_code >= 15)
+	{
+		op = putLength(op, match_code - 15);
+	}
+	
+	return op;
+}
+
+
+//'out' must hold LZ_BOUND(length) bytes and 'hash' LZ_HASH_SIZE entries,
+//'length' is at most LZ_MAX_INPUT. Returns the compressed size.
+uint32_t lzCompress(const uint8_t* in, uint32_t length, uint8_t* out, uint16_t* hash)
+{
+	const uint8_t* ip = in;
+	const uint8_t* anchor = in;
+	const uint8_t* end = in + length;
+	uint8_t* op = out;
+	
+	memset(hash, 0, sizeof(uint16_t)*LZ_HASH_SIZE);
+	
+	//the last bytes are always literals, so matches never read past the end
+	while (length >= 2*LZ_MIN_MATCH && ip + LZ_MIN_MATCH <= end - LZ_MIN_MATCH)
+	{
+		uint32_t value = read32(ip);
+		uint32_t h = hash32(value);
+		const uint8_t* ref = in + hash[h];
+		
+		hash[h] = ip - in;
+		
+		if (ref >= ip || ip - ref > 0xFFFF || read32(ref) != value)
+		{
+			ip++;
+			continue;
+		}
+		
+		//extend backwards over literals and forwards as far as it goes
+		while (ip > anchor && ref > in && ip[-1] == ref[-1])
+		{
+			ip--;
+			ref--;
+		}
+		
+		uint32_t match = LZ_MIN_MATCH;
+		
+		while (ip + match < end - LZ_MIN_MATCH && ip[match] == ref[match])
+		{
+			match++;
+		}
+		
+		op = putSequence(op, anchor, ip - anchor, ip - ref, match);
+		ip += match;
+		anchor = ip;
+		
+		if (ip + LZ_MIN_MATCH <= end)
+		{
+			hash[hash32(read32(ip - 2))] = ip - 2 - in;
+		}
+	}
+	
+	op = putSequence(op, anchor, end - anchor, 0, 0);
+	
+	return op - out;
+}
+
+
+static int getLength(const uint8_t** ip, const uint8_t* end, uint32_t* length)
+{
+	uint8_t byte;
+	
+	do
+	{
+		if (*ip >= end)
+		{
+			return 0;
+		}
+		
+		byte = *(*ip)++;
+		*length += byte;
+	}
+	while (byte == 255);
+	
+	return 1;
+}
+
+
+//returns the decompressed size, or -1 if the input is damaged or would not
+//fit in 'capacity' bytes
+int32_t lzDecompress(const uint8_t* in, uint32_t length, uint8_t* out, uint32_t capacity)
+{
+	const uint8_t* ip = in;
+	const uint8_t* end = in + length;
+	uint8_t* op = out;
+	uint8_t* out_end = out + capacity;
+	
+	while (ip < end)
+	{
+		uint8_t token = *ip++;
+		uint32_t n_literals = token >> 4;
+		
+		if (n_literals == 15 && !getLength(&ip, end, &n_literals))
+		{
+			return -1;
+		}
+		
+		if (n_literals > end - ip || n_literals > out_end - op)
+		{
+			return -1;
+		}
+		
+		memcpy(op, ip, n_literals);
+		op += n_literals;
+		ip += n_literals;
+		
+		if (ip == end)
+		{
+			break;
+		}
+		
+		if (end - ip < 2)
+		{
+			return -1;
+		}
+		
+		uint32_t offset = ip[0] | (ip[1] << 8);
+		uint32_t match = (token & 0x0F) + LZ_MIN_MATCH;
+		ip += 2;
+		
+		if ((token & 0x0F) == 15 && !getLength(&ip, end, &match))
+		{
+			return -1;
+		}
+		
+		if (offset == 0 || offset > op - out || match > out_end - op)
+		{
+			return -1;
+		}
+		
+		const uint8_t* ref = op - offset;
+		
+		//whole words when the source is far enough back not to overlap
+		if (offset >= 8)
+		{
+			while (match >= 8)
+			{
+				memcpy(op, ref, 8);
+				op += 8;
+				ref += 8;
+				match -= 8;
+			}
+		}
+		
+		while (match--)
+		{
+			*op++ = *ref++;
+		}
+	}
+	
+	return op - out;
+}
@@ -0,0 +1,19 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_HASH_BITS			12
+#define LZ_HASH_SIZE			(1 << LZ_HASH_BITS)
+#define LZ_MIN_MATCH			4
+#define LZ_MAX_INPUT			65536	//offsets are 16 bits, so are the hash entries
+#define LZ_BOUND(n)				((n) + (n)/255 + 16)	//largest output for 'n' input bytes
+
+//byte-aligned LZ77 in the LZ4 block layout: a token of literal and match
+//lengths, the literals, then a 16-bit back reference. There is no entropy
+//stage, decoding is only copies.
+uint32_t lzCompress(const uint8_t* in, uint32_t length, uint8_t* out, uint16_t* hash);
+int32_t lzDecompress(const uint8_t* in, uint32_t length, uint8_t* out, uint32_t capacity);
+
+#endif
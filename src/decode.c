@@ -0,0 +1,158 @@
+#include "decode.h"
+
+#define DECODE_BATCH			(MAX_PACKET_DATA/4)	//registers converted to floats per call
+
+typedef void (*register_handler)(const uint8_t* data, void* field, float scale);
+
+//a float register has no handler, it is stored from the batch conversion
+typedef struct 
+{
+  register_handler handler;
+  uint16_t offset;			//offset of the first destination field in imu_state
+  uint16_t group;			//DECODED_* flag set when this register is decoded
+  float scale;
+} register_decoder;
+
+//two signed 16-bit values packed high half first into consecutive floats
+static void decodeInt16Pair(const uint8_t* data, void* field, float scale)
+{
+	float* out = (float*)field;
+	
+	out[0] = (int16_t)((data[0] << 8) | data[1])/scale;
+	out[1] = (int16_t)((data[2] << 8) | data[3])/scale;
+}
+
+
+//one signed 16-bit value in the high half, the low half is reserved
+static void decodeInt16(const uint8_t* data, void* field, float scale)
+{
+	*(float*)field = (int16_t)((data[0] << 8) | data[1])/scale;
+}
+
+
+static void decodeHealthRegister(const uint8_t* data, void* field, float scale)
+{
+	decodeHealth(bit8ArrayToBit32((uint8_t*)data), (heartbeat*)field);
+}
+
+#define FLOAT_REG(field, group)			{NULL, offsetof(imu_state, field), group, 1.0f}
+#define INT16_PAIR_REG(field, group, s)	{decodeInt16Pair, offsetof(imu_state, field), group, s}
+#define INT16_REG(field, group, s)		{decodeInt16, offsetof(imu_state, field), group, s}
+
+//dispatch table indexed by register address, unlisted registers are skipped
+static const register_decoder decoders[256] = 
+{
+	[DREG_HEALTH] 				= {decodeHealthRegister, offsetof(imu_state, health), DECODED_HEALTH, 1.0f},
+	
+	[DREG_TEMPERATURE] 			= FLOAT_REG(temperature, DECODED_TEMPERATURE),
+	[DREG_TEMPERATURE_TIME] 	= FLOAT_REG(temperature_time, DECODED_TEMPERATURE),
+	
+	[DREG_GYRO_PROC_X] 			= FLOAT_REG(gyro.x, DECODED_GYRO),
+	[DREG_GYRO_PROC_Y] 			= FLOAT_REG(gyro.y, DECODED_GYRO),
+	[DREG_GYRO_PROC_Z] 			= FLOAT_REG(gyro.z, DECODED_GYRO),
+	[DREG_GYRO_PROC_TIME] 		= FLOAT_REG(gyro.time, DECODED_GYRO),
+	
+	[DREG_ACCEL_PROC_X] 		= FLOAT_REG(accel.x, DECODED_ACCEL),
+	[DREG_ACCEL_PROC_Y] 		= FLOAT_REG(accel.y, DECODED_ACCEL),
+	[DREG_ACCEL_PROC_Z] 		= FLOAT_REG(accel.z, DECODED_ACCEL),
+	[DREG_ACCEL_PROC_TIME] 		= FLOAT_REG(accel.time, DECODED_ACCEL),
+	
+	[DREG_MAG_PROC_X] 			= FLOAT_REG(mag.x, DECODED_MAG),
+	[DREG_MAG_PROC_Y] 			= FLOAT_REG(mag.y, DECODED_MAG),
+	[DREG_MAG_PROC_Z] 			= FLOAT_REG(mag.z, DECODED_MAG),
+	[DREG_MAG_PROC_TIME] 		= FLOAT_REG(mag.time, DECODED_MAG),
+	
+	[DREG_QUAT_AB] 				= INT16_PAIR_REG(quat.a, DECODED_QUAT, QUAT_SCALE),
+	[DREG_QUAT_CD] 				= INT16_PAIR_REG(quat.c, DECODED_QUAT, QUAT_SCALE),
+	[DREG_QUAT_TIME] 			= FLOAT_REG(quat.time, DECODED_QUAT),
+	
+	[DREG_EULER_PHI_THETA] 		= INT16_PAIR_REG(euler.roll, DECODED_EULER, EULER_SCALE),
+	[DREG_EULER_PSI] 			= INT16_REG(euler.yaw, DECODED_EULER, EULER_SCALE),
+	[DREG_EULER_PHI_THETA_DOT] 	= INT16_PAIR_REG(euler.roll_rate, DECODED_EULER, EULER_RATE_SCALE),
+	[DREG_EULER_PSI_DOT] 		= INT16_REG(euler.yaw_rate, DECODED_EULER, EULER_RATE_SCALE),
+	[DREG_EULER_TIME] 			= FLOAT_REG(euler.time, DECODED_EULER),
+	
+	[DREG_POSITION_N] 			= FLOAT_REG(position.x, DECODED_POSITION),
+	[DREG_POSITION_E] 			= FLOAT_REG(position.y, DECODED_POSITION),
+	[DREG_POSITION_UP] 			= FLOAT_REG(position.z, DECODED_POSITION),
+	[DREG_POSITION_TIME] 		= FLOAT_REG(position.time, DECODED_POSITION),
+	
+	[DREG_VELOCITY_N] 			= FLOAT_REG(velocity.x, DECODED_VELOCITY),
+	[DREG_VELOCITY_E] 			= FLOAT_REG(velocity.y, DECODED_VELOCITY),
+	[DREG_VELOCITY_UP] 			= FLOAT_REG(velocity.z, DECODED_VELOCITY),
+	[DREG_VELOCITY_TIME] 		= FLOAT_REG(velocity.time, DECODED_VELOCITY),
+	
+	[DREG_GPS_LATITUDE] 		= FLOAT_REG(gps.latitude, DECODED_GPS),
+	[DREG_GPS_LONGITUDE] 		= FLOAT_REG(gps.longitude, DECODED_GPS),
+	[DREG_GPS_ALTITUDE] 		= FLOAT_REG(gps.altitude, DECODED_GPS),
+	[DREG_GPS_COURSE] 			= FLOAT_REG(gps.course, DECODED_GPS),
+	[DREG_GPS_SPEED] 			= FLOAT_REG(gps.speed, DECODED_GPS),
+	[DREG_GPS_TIME] 			= FLOAT_REG(gps.time, DECODED_GPS),
+};
+
+
+// Decode 'n_registers' consecutive 4-byte registers starting at 'address' 
+// straight into the typed state in one pass. Returns the DECODED_* flags of
+// every sample group that was touched.
+uint32_t decodeRegisters(uint8_t address, const uint8_t* data, int n_registers, imu_state* state)
+{
+	uint32_t updated = 0;
+	float values[DECODE_BATCH];
+	
+	//a whole batch packet is byte swapped in one call, then the float
+	//registers are scattered into the state and the packed ones decoded
+	for (int first = 0; first < n_registers; first += DECODE_BATCH)
+	{
+		int n = (n_registers - first < DECODE_BATCH) ? n_registers - first : DECODE_BATCH;
+		
+		bit8ArrayToFloats(&data[4*first], values, n);
+		
+		for (int i = 0; i < n; i++)
+		{
+			const register_decoder* decoder = &decoders[(uint8_t)(address + first + i)];
+			void* field = (uint8_t*)state + decoder->offset;
+			
+			if (decoder->handler)
+			{
+				decoder->handler(&data[4*(first + i)], field, decoder->scale);
+			}
+			else if (decoder->group)
+			{
+				*(float*)field = values[i];
+			}
+			
+			updated |= decoder->group;
+		}
+	}
+	
+	return updated;
+}
+
+
+//single and batch packets alike, a batch such as DREG_ALL_PROC covers 
+//n_data_bytes/4 registers starting at the packet address
+uint32_t decodePacket(const packet* rx_packet, imu_state* state)
+{
+	if (!(rx_packet->packet_type & PT_HAS_DATA))
+	{
+		return 0;
+	}
+	
+	return decodeRegisters(rx_packet->address, rx_packet->data, rx_packet->n_data_bytes/4, state);
+}
+
+
+void decodeHealth(uint32_t health_reg, heartbeat* beat)
+{
+	beat->gps_fail = checkBit(health_reg, 0);
+	beat->mag_fail = checkBit(health_reg, 1);
+	beat->gyro_fail = checkBit(health_reg, 2);
+	beat->acc_fail = checkBit(health_reg, 3);
+	beat->acc_norm = checkBit(health_reg, 4);
+	beat->mag_norm = checkBit(health_reg, 5);
+	beat->uart_fail = checkBit(health_reg, 8);
+	
+	beat->sats_view = (health_reg >> 10) & 0x3F;
+	beat->hdop = (health_reg >> 16) & 0x3FF;
+	beat->sats_used = (health_reg >> 26) & 0x3F;
+}
@@ -0,0 +1,97 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "um7.h"
+#include "binary.h"
+
+#define QUAT_SCALE				29789.09f	//quaternion components are int16 * 1/29789.09
+#define EULER_SCALE				91.02222f	//euler angles are int16 * 1/91.02222 degrees
+#define EULER_RATE_SCALE		16.0f		//euler rates are int16 * 1/16 degrees per second
+
+//bit flags returned by decodePacket for each sample group that was updated
+#define DECODED_HEALTH			(1 << 0)
+#define DECODED_TEMPERATURE		(1 << 1)
+#define DECODED_GYRO			(1 << 2)
+#define DECODED_ACCEL			(1 << 3)
+#define DECODED_MAG				(1 << 4)
+#define DECODED_QUAT			(1 << 5)
+#define DECODED_EULER			(1 << 6)
+#define DECODED_POSITION		(1 << 7)
+#define DECODED_VELOCITY		(1 << 8)
+#define DECODED_GPS				(1 << 9)
+
+//when a sample was taken on the host clock, CLOCK_MONOTONIC_RAW nanoseconds
+typedef struct
+{
+  uint64_t host;			//read from the port, less the time of the bytes behind it
+  uint64_t aligned;			//device time register mapped onto the host clock, 0 until locked
+} sample_stamp;
+
+typedef struct 
+{
+  float x;
+  float y;
+  float z;
+  float time;
+  sample_stamp stamp;
+} vector_sample;
+
+typedef struct 
+{
+  float a;
+  float b;
+  float c;
+  float d;
+  float time;
+  sample_stamp stamp;
+} quat_sample;
+
+typedef struct 
+{
+  float roll;
+  float pitch;
+  float yaw;
+  float roll_rate;
+  float pitch_rate;
+  float yaw_rate;
+  float time;
+  sample_stamp stamp;
+} euler_sample;
+
+typedef struct 
+{
+  float latitude;
+  float longitude;
+  float altitude;
+  float course;
+  float speed;
+  float time;
+  sample_stamp stamp;
+} gps_sample;
+
+//latest decoded value of every data register, all fields are in physical units
+typedef struct 
+{
+  vector_sample gyro;		//degrees per second
+  vector_sample accel;		//gravities
+  vector_sample mag;		//unit norm
+  quat_sample quat;
+  euler_sample euler;		//degrees, degrees per second
+  vector_sample position;	//metres north, east, up of home
+  vector_sample velocity;	//metres per second north, east, up
+  gps_sample gps;
+  heartbeat health;
+  float temperature;		//degrees celsius
+  float temperature_time;
+  sample_stamp temperature_stamp;
+} imu_state;
+
+uint32_t decodePacket(const packet* rx_packet, imu_state* state);
+uint32_t decodeRegisters(uint8_t address, const uint8_t* data, int n_registers, imu_state* state);
+void decodeHealth(uint32_t health_reg, heartbeat* beat);
+
+#endif
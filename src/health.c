@@ -0,0 +1,68 @@
+#include "health.h"
+
+static const struct
+{
+  uint32_t flag;
+  const char* name;
+} health_names[] =
+{
+	{HEALTH_GPS_FAIL, 	"gps_fail"},
+	{HEALTH_MAG_FAIL, 	"mag_fail"},
+	{HEALTH_GYRO_FAIL, 	"gyro_fail"},
+	{HEALTH_ACC_FAIL, 	"acc_fail"},
+	{HEALTH_ACC_NORM, 	"acc_norm"},
+	{HEALTH_MAG_NORM, 	"mag_norm"},
+	{HEALTH_UART_FAIL, 	"uart_fail"},
+};
+
+void initHealthMonitor(health_monitor* monitor)
+{
+	memset(monitor, 0, sizeof(health_monitor));
+}
+
+
+uint32_t healthFlags(const heartbeat* beat)
+{
+	uint32_t flags = 0;
+	
+	flags |= beat->gps_fail ? HEALTH_GPS_FAIL : 0;
+	flags |= beat->mag_fail ? HEALTH_MAG_FAIL : 0;
+	flags |= beat->gyro_fail ? HEALTH_GYRO_FAIL : 0;
+	flags |= beat->acc_fail ? HEALTH_ACC_FAIL : 0;
+	flags |= beat->acc_norm ? HEALTH_ACC_NORM : 0;
+	flags |= beat->mag_norm ? HEALTH_MAG_NORM : 0;
+	flags |= beat->uart_fail ? HEALTH_UART_FAIL : 0;
+	
+	return flags;
+}
+
+
+//takes the latest decoded health register, returns the flags that changed
+//since the last one. The device is taken to be healthy before its first
+//health packet, so faults present from the start are reported too.
+uint32_t updateHealth(health_monitor* monitor, const heartbeat* beat)
+{
+	uint32_t flags = healthFlags(beat);
+	uint32_t changed = flags ^ monitor->flags;
+	
+	if (changed)
+	{
+		monitor->flags = flags;
+		monitor->transitions++;
+	}
+	
+	return changed;
+}
+
+
+//one line naming each changed flag and whether it was raised or cleared
+void printHealthChanges(FILE* stream, uint32_t flags, uint32_t changed)
+{
+	for (int i = 0; i < sizeof(health_names)/sizeof(health_names[0]); i++)
+	{
+		if (changed & health_names[i].flag)
+		{
+			fprintf(stream, " %s %s", health_names[i].name, (flags & health_names[i].flag) ? "raised" : "cleared");
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "um7.h"
+
+//fault flags, at their bit positions in DREG_HEALTH
+#define HEALTH_GPS_FAIL			(1 << 0)	//no GPS data for 2 seconds
+#define HEALTH_MAG_FAIL			(1 << 1)
+#define HEALTH_GYRO_FAIL		(1 << 2)
+#define HEALTH_ACC_FAIL			(1 << 3)
+#define HEALTH_ACC_NORM			(1 << 4)	//aggressive acceleration
+#define HEALTH_MAG_NORM			(1 << 5)	//bad magnetometer calibration
+#define HEALTH_UART_FAIL		(1 << 8)	//UM7 transmit buffer overflow
+
+//last fault flags seen on one device, health packets are compared to it as
+//they stream past so a fault is reported once when it appears and once
+//when it clears
+typedef struct
+{
+  uint32_t flags;
+  uint64_t transitions;
+} health_monitor;
+
+void initHealthMonitor(health_monitor* monitor);
+uint32_t healthFlags(const heartbeat* beat);
+uint32_t updateHealth(health_monitor* monitor, const heartbeat* beat);
+void printHealthChanges(FILE* stream, uint32_t flags, uint32_t changed);
+
+#endif
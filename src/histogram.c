@@ -0,0 +1,89 @@
+#include "histogram.h"
+
+void initHistogram(latency_histogram* h)
+{
+	memset(h, 0, sizeof(latency_histogram));
+	h->min = UINT64_MAX;
+}
+
+
+static int bucketIndex(uint64_t value)
+{
+	if (value < 2*HISTOGRAM_SUB_BUCKETS)
+	{
+		return value;
+	}
+	
+	int shift = 63 - __builtin_clzll(value) - HISTOGRAM_PRECISION;
+	
+	return shift*HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+
+//largest value that lands in bucket 'index'
+static uint64_t bucketValue(int index)
+{
+	if (index < 2*HISTOGRAM_SUB_BUCKETS)
+	{
+		return index;
+	}
+	
+	int shift = index/HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t mantissa = index - shift*HISTOGRAM_SUB_BUCKETS;
+	
+	return ((mantissa + 1) << shift) - 1;
+}
+
+
+//relaxed atomics: a reader may see a count a value or two behind, never a 
+//torn one
+void recordHistogram(latency_histogram* h, uint64_t value)
+{
+	__atomic_fetch_add(&h->counts[bucketIndex(value)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	
+	if (value < __atomic_load_n(&h->min, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&h->min, value, __ATOMIC_RELAXED);
+	}
+	
+	if (value > __atomic_load_n(&h->max, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+
+//value below which 'percentile' percent of the recorded values fall, to the
+//histogram precision, 0 when nothing has been recorded
+uint64_t histogramPercentile(const latency_histogram* h, double percentile)
+{
+	uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	
+	if (count == 0)
+	{
+		return 0;
+	}
+	
+	uint64_t target = (uint64_t)(percentile/100.0*count + 0.5);
+	uint64_t seen = 0;
+	
+	if (target < 1)
+	{
+		target = 1;
+	}
+	
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+		
+		if (seen >= target)
+		{
+			uint64_t value = bucketValue(i);
+			return (value < max) ? value : max;
+		}
+	}
+	
+	return max;
+}
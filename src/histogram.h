@@ -0,0 +1,26 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HISTOGRAM_PRECISION		5		//sub-bucket bits, values are kept to about 3%
+#define HISTOGRAM_SUB_BUCKETS	(1 << HISTOGRAM_PRECISION)
+#define HISTOGRAM_BUCKETS		((65 - HISTOGRAM_PRECISION)*HISTOGRAM_SUB_BUCKETS)
+
+//log-linear histogram of 64-bit values in the style of HdrHistogram: exact
+//below 2*HISTOGRAM_SUB_BUCKETS, then HISTOGRAM_SUB_BUCKETS buckets per power
+//of two. One thread records, any thread may read the percentiles.
+typedef struct
+{
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t min;
+  uint64_t max;
+} latency_histogram;
+
+void initHistogram(latency_histogram* h);
+void recordHistogram(latency_histogram* h, uint64_t value);
+uint64_t histogramPercentile(const latency_histogram* h, double percentile);
+
+#endif
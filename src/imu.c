@@ -1,237 +1,127 @@
 #include "imu.h"
 
-struct sp_port *port;
-struct sp_port_config *port_config;
-
-uint8_t* byte_buffer;
 uint8_t zero_buffer[4] = {0, 0, 0, 0};
 
-packet global_packet;
-heartbeat beat;
-
-// Parse the serial data obtained through the UART interface and fit to a general packet structure
-uint8_t parseUART(int address, uint8_t* rx_data, uint8_t rx_length)
+void initDevice(imu_device* dev, int index, device_metrics* metrics)
 {
-	uint8_t index;
-	// Make sure that the data buffer provided is long enough to contain a full packet
-	// The minimum packet length is 7 bytes
-	if (rx_length < 7)
-	{
-		//buffer length too short to contain a valid packet
-		return 0;		
-	}
-	
-	// Try to find the 'snp' start sequence for the packet
-	for (index = 0; index < (rx_length - 2); index++)
-    {
-		// Check for 'snp'. If found, immediately exit the loop
-		if (rx_data[index] == 's' && rx_data[index+1] == 'n' && rx_data[index+2] == 'p')
-		{
-			//found valid SNP
-			uint8_t packet_index = index;
-	
-			// Check to see if the variable 'packet_index' is equal to (rx_length - 2). If it is, then the above
-			// loop executed to completion and never found a packet header.
-			if (packet_index == (rx_length - 2))
-			{
-				return 0;
-			}
-			
-			// If we get here, a packet header was found. Now check to see if we have enough room
-			// left in the buffer to contain a full packet. Note that at this point, the variable 'packet_index'
-			// contains the location of the 's' character in the buffer (the first byte in the header)
-			if ((rx_length - packet_index) < 7)
-			{
-				return 0;
-			}
-			
-			// We've found a packet header, and there is enough space left in the buffer for at least
-			// the smallest allowable packet length (7 bytes). Pull out the packet type byte to determine
-			// the actual length of this packet
-			uint8_t PT = rx_data[packet_index + 3];
-
-			// Do some bit-level manipulation to determine if the packet contains data and if it is a batch
-			// We have to do this because the individual bits in the PT byte specify the contents of the
-			// packet.
-			uint8_t packet_has_data = (PT >> 7) & 0x01; // Check bit 7 (HAS_DATA)
-			uint8_t packet_is_batch = (PT >> 6) & 0x01; // Check bit 6 (IS_BATCH)
-			uint8_t batch_length = (PT >> 2) & 0x0F; // Extract the batch length (bits 2 through 5)
-
-			// Now finally figure out the actual packet length
-			uint8_t data_length = 0;
-			if (packet_has_data)
-			{
-				if (packet_is_batch)
-				{
-					// Packet has data and is a batch. This means it contains 'batch_length' registers, each
-					// of which has a length of 4 bytes
-					data_length = 4*batch_length;
-					//printf("Packet is batch, length = %i\n", (int)(data_length));
-				}
-				else // Packet has data but is not a batch. This means it contains one register (4 bytes)   
-				{
-					data_length = 4;
-				}
-			}
-			else // Packet has no data
-			{
-				data_length = 0;
-			}
-			
-			// At this point, we know exactly how long the packet is. Now we can check to make sure
-			// we have enough data for the full packet.
-			if( (rx_length - packet_index) < (data_length + 5) )
-			{
-				//printf("Not enough data for full packet!\n");
-				return 0;
-			}
-			
-			// If we get here, we know that we have a full packet in the buffer. All that remains is to pull
-			// out the data and make sure the checksum is good.
-			// Start by extracting all the data
-			global_packet.address = rx_data[packet_index + 4];	
-			global_packet.packet_type = PT;
-			
-			if (global_packet.address != address)
-			{
-				//printf("Wrong packet address, looking again!\n");
-				//packet address does not match search address
-				//increase the loop index and look for a new valid packet
-				continue;
-			}
-			//printf("Found one!\n");
-
-			// Get the data bytes and compute the checksum all in one step
-			global_packet.n_data_bytes = data_length;
-			uint16_t computed_checksum = 's' + 'n' + 'p' + global_packet.packet_type + global_packet.address;	
-			
-			for( int k = 0; k < data_length; k++ )
-			{
-				// Copy the data into the packet structure's data array
-				global_packet.data[k] = rx_data[packet_index + 5 + k];
-				// Add the new byte to the checksum
-				computed_checksum += global_packet.data[k];		
-			}    
-		   
-			// Now see if our computed checksum matches the received checksum
-			// First extract the checksum from the packet
-			uint16_t received_checksum = (rx_data[packet_index + 5 + data_length] << 8);
-
-			received_checksum |= rx_data[packet_index + 6 + data_length];
-			// Now check to see if they don't match
-			if (received_checksum != computed_checksum)
-			{
-				//checksum is bad
-				//increase the loop index and look for a new valid packet
-				return 0;
-			}
-			
-			//printf("checksum good!\n");
-			global_packet.checksum = computed_checksum;
-			// At this point, we've received a full packet with a good checksum. It is already
-			// fully parsed and copied to the packet structure, so return 0 to indicate that a packet was
-			// processed.
-			return 1;			
-		}
-    }    
-    
-    return 0;	
+	memset(dev, 0, sizeof(imu_device));
+	
+	dev->index = index;
+	dev->metrics = metrics;
+	dev->fd = -1;
+	dev->baud_rate = UART_BAUD_RATE;
+	
+	initParser(&dev->uart_parser);
+	initQueue(&dev->queue);
+	initClockAlign(&dev->align);
+	initSnapshot(&dev->latest);
+	initHealthMonitor(&dev->health);
 }
 
 
-void initIMU(int is_debug_mode, int is_reset)
+void initIMU(imu_device* dev, int is_debug_mode, int is_reset, const rate_profile* profile)
 {
-	byte_buffer = (uint8_t*)malloc(UART_BYTE_BUFFER*sizeof(uint8_t));	
-	
 	if (is_reset)
 	{
-		writeCommand(RESET_TO_FACTORY);
+		writeCommand(dev, RESET_TO_FACTORY);
 	}
 	
 	if (is_debug_mode)
 	{
-		if (writeCommand(GET_FW_REVISION))
+		if (writeCommand(dev, GET_FW_REVISION))
 		{		
 			char FWrev[5];
-			FWrev[0] = global_packet.data[0];
-			FWrev[1] = global_packet.data[1];
-			FWrev[2] = global_packet.data[2];
-			FWrev[3] = global_packet.data[3];
+			FWrev[0] = dev->response.data[0];
+			FWrev[1] = dev->response.data[1];
+			FWrev[2] = dev->response.data[2];
+			FWrev[3] = dev->response.data[3];
 			FWrev[4] = '\0'; //Null-terminate string
 
 			cprint("[**] ", BRIGHT, CYAN);
 			printf("Firmware Version: %s\n", FWrev);
 		}
-		
+	}
+	
+	if (profile)
+	{
 		cprint("[**] ", BRIGHT, CYAN);
 		printf("Reseting IMU registers.\n");
 		
-		//baud rate of the UM7 main serial port = 115200 (5)
-		//baud rate of the UM7 auxiliary serial port = 57600 (4)
-
-		uint8_t com_settings[4]  = {(4 << 0) + (5 << 4), 0, 0, 0};	
-		uint8_t health_rate[4] 	 = {0, 1, 0, 0};
-		uint8_t chr_nmea_rate[4] = {(1 << 0) + (1 << 4), 0, (1 << 0) + (1 << 4), 0};
-		uint8_t all_proc_rate[4] = {0, 0, 0, 0};
-		uint8_t position_rate[4] = {0, 0, 0, 0};
+		if (!applyProfile(dev, profile))
+		{
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	if (is_debug_mode)
+	{
 		uint8_t misc_settings[4] = {0, 0, 1, 1};
 		
-		writeRegister(CREG_COM_SETTINGS, 4, com_settings);		// baud rates, auto transmission		
-		writeRegister(CREG_COM_RATES1, 4, zero_buffer);			// raw gyro, accel and mag rate	
-		writeRegister(CREG_COM_RATES2, 4, zero_buffer);			// temp rate and all raw data rate		
-		writeRegister(CREG_COM_RATES3, 4, zero_buffer);			// proc accel, gyro, mag rate		
-		writeRegister(CREG_COM_RATES4, 4, all_proc_rate);		// all proc data rate	
-		writeRegister(CREG_COM_RATES5, 4, position_rate);		// quart, euler, position, velocity rate
-		writeRegister(CREG_COM_RATES6, 4, health_rate);			// heartbeat rate
-		writeRegister(CREG_COM_RATES7, 4, chr_nmea_rate);		// CHR NMEA-style packets
-		writeRegister(CREG_MISC_SETTINGS, 4, misc_settings);	// miscellaneous filter and sensor control options
-	
-		//writeCommand(FLASH_COMMIT);
-		writeCommand(ZERO_GYROS);
-		writeCommand(SET_MAG_REFERENCE);
-		writeCommand(SET_HOME_POSITION);
-		writeCommand(RESET_EKF);
+		writeRegister(dev, CREG_MISC_SETTINGS, 4, misc_settings);	// miscellaneous filter and sensor control options
+	
+		//writeCommand(dev, FLASH_COMMIT);
+		writeCommand(dev, ZERO_GYROS);
+		writeCommand(dev, SET_MAG_REFERENCE);
+		writeCommand(dev, SET_HOME_POSITION);
+		writeCommand(dev, RESET_EKF);
 	
 		//let gps lock before setting reference points 
-		/*while (beat.sats_used < 3)
+		/*while (dev->beat.sats_used < 3)
 		{
-			getHeartbeat();
-			printHeartbeat();
+			getHeartbeat(dev);
+			printHeartbeat(&dev->beat);
 		}*/
 	}
 		
-	printHome();
+	printHome(dev);
 }
 
 
-int txPacket(packet* tx_packet)
-{  
-	int msg_len = tx_packet->n_data_bytes + 7;
-
-	uint8_t tx_buffer[msg_len + 1];
-	//Add header to buffer
-	tx_buffer[0] = 's';
-	tx_buffer[1] = 'n';
-	tx_buffer[2] = 'p';
-	tx_buffer[3] = tx_packet->packet_type;
-	tx_buffer[4] = tx_packet->address;
-	
-	//Calculate checksum and add data to buffer
-	uint16_t checksum = 's' + 'n' + 'p' + tx_buffer[3] + tx_buffer[4];
+//switches the UM7 main port and then the host port to the profile baud rate
+//and writes the broadcast rates. If the device does not answer at the new 
+//rate the host goes back to the old one.
+int applyProfile(imu_device* dev, const rate_profile* profile)
+{
+	//baud rate of the UM7 auxiliary serial port = 57600 (4)
+	uint8_t com_settings[4] = {(PROFILE_GPS_BAUD << 0) + (baudRateCode(profile->baud_rate) << 4), 0, 0, 0};
+	int old_baud_rate = dev->baud_rate;
 	
-	int i;
+	// baud rates, auto transmission, acknowledged at the old rate
+	writeRegister(dev, CREG_COM_SETTINGS, 4, com_settings);
 	
-	for (i = 0; i < tx_packet->n_data_bytes; i++)
+	if (profile->baud_rate != old_baud_rate)
 	{
-		tx_buffer[5 + i] = tx_packet->data[i];
-		checksum += tx_packet->data[i];
+		sp_drain(dev->port);
+		setBaudRate(dev, profile->baud_rate);
+		
+		uint8_t data[4];
+		
+		if (!readRegister(dev, CREG_COM_SETTINGS, data))
+		{
+			setBaudRate(dev, old_baud_rate);
+			
+			cprint("[!!] ", BRIGHT, RED);
+			printf("IMU did not follow the switch to %i baud.\n", profile->baud_rate);
+			return 0;
+		}
+		
+		cprint("[OK] ", BRIGHT, GREEN);
+		printf("Switched to %i baud.\n", profile->baud_rate);
 	}
 	
-	tx_buffer[5 + i] = checksum >> 8;
-	tx_buffer[6 + i] = checksum & 0xff;
+	// raw, processed, attitude, health and NMEA broadcast rates in one packet
+	return writeRegisters(dev, CREG_COM_RATES1, 7, profile->rates[0]);
+}
+
+
+int txPacket(imu_device* dev, packet* tx_packet)
+{  
+	uint8_t tx_buffer[MAX_PACKET_LENGTH + 1];
+	
+	int msg_len = encodePacket(tx_packet, tx_buffer);
 	tx_buffer[msg_len++] = 0x0a; //new line numerical value
 	
-	if (sp_nonblocking_write(port, (const void*)tx_buffer, msg_len) < 0)
+	if (sp_nonblocking_write(dev->port, (const void*)tx_buffer, msg_len) < 0)
 	{
 		cprint("[!!] ", BRIGHT, RED);
 		fprintf(stderr, "UART write error.\n");
@@ -241,16 +131,24 @@ int txPacket(packet* tx_packet)
 	return 1;
 }
 
-//searches for the first valid paket within 'size' samples of the UART buffer
-//that matches a specified address in a number of attempts
-int rxPacket(int address, int attempts)
+//searches for the first valid paket in the UART stream that matches a 
+//specified address in a number of attempts, packets split across reads are 
+//kept in the parser ring until they are complete
+int rxPacket(imu_device* dev, int address, int attempts)
 {
 	for (int i = 0; i < attempts; i++)
 	{
-		if (parseUART(address, byte_buffer, getUART()) == 1) 
+		parserPush(&dev->uart_parser, dev->byte_buffer, waitUART(dev, 1, UART_TIMEOUT_MS));
+		
+		while (parserNext(&dev->uart_parser, &dev->response))
 		{
-			//found valid packet matching address -> global packet
-			return 1; 
+			if (dev->response.address == address) 
+			{
+				//found valid packet matching address -> global packet
+				return 1; 
+			}
+			
+			addCounter(&dev->metrics->address_mismatches, 1);
 		}
 	}
 
@@ -259,98 +157,319 @@ int rxPacket(int address, int attempts)
 }
 
 
-int writeRegister(uint8_t address, uint8_t n_data_bytes, uint8_t *data)
+static void printNoResponse(uint8_t address)
 {
-	packet tx_packet;	
+	cprint("[!!] ", BRIGHT, RED);
+	printf("No response from ");
+	
+	switch (address)
+	{
+		case CREG_COM_SETTINGS: 
+			printf("CREG_COM_SETTINGS.\n");
+			break;
+		case CREG_COM_RATES1: 
+			printf("CREG_COM_RATES1.\n");
+			break;	
+		case CREG_COM_RATES2:
+			printf("CREG_COM_RATES2.\n");
+			break;	
+		case CREG_COM_RATES3:
+			printf("CREG_COM_RATES3.\n");
+			break;	
+		case CREG_COM_RATES4:
+			printf("CREG_COM_RATES4.\n");
+			break;
+		case CREG_COM_RATES5:	
+			printf("CREG_COM_RATES5.\n");
+			break;
+		case CREG_COM_RATES6:
+			printf("CREG_COM_RATES6.\n");
+			break;
+		case CREG_COM_RATES7:
+			printf("CREG_COM_RATES7.\n");
+			break;
+		case CREG_MISC_SETTINGS:
+			printf("CREG_MISC_SETTINGS.\n");
+			break;
+		case DREG_HEALTH:
+			printf("DREG_HEALTH.\n");
+			break;
+		case RESET_EKF:
+			printf("RESET_EKF.\n");
+			break;
+		case RESET_TO_FACTORY:
+			printf("RESET_TO_FACTORY.\n");
+			break;
+		case GET_FW_REVISION:
+			printf("GET_FW_REVISION.\n");
+			break;
+		default:
+			printf("UM7_R%i.\n", address);
+			break;
+	}
+}
+
 
-	tx_packet.address = address;
-	tx_packet.packet_type = 0;
-	tx_packet.n_data_bytes = n_data_bytes;	
+//keeps up to TRANSACTION_WINDOW requests of 'set' on the wire and resends 
+//each one when its own deadline passes, returns once every request has 
+//been answered or has run out of attempts
+int runTransactions(imu_device* dev, transaction_set* set)
+{
+	packet rx_packet;
 	
-	if (n_data_bytes != 0)
+	while (!transactionsFinished(set))
 	{
-		tx_packet.packet_type |= PT_HAS_DATA; // packet contains data			
-	}	
+		uint64_t now = hostTime();
+		transaction* t;
+		
+		expireTransactions(set, now);
+		
+		while ((t = nextTransaction(set, now)))
+		{
+			txPacket(dev, &t->request);
+		}
+		
+		uint64_t deadline = transactionDeadline(set);
+		int timeout_ms = (deadline > now) ? (deadline - now + 999999)/1000000 : 0;
+		
+		parserPush(&dev->uart_parser, dev->byte_buffer, waitUART(dev, 1, timeout_ms));
+		
+		while (parserNext(&dev->uart_parser, &rx_packet))
+		{
+			if (!matchTransaction(set, &rx_packet))
+			{
+				addCounter(&dev->metrics->address_mismatches, 1);
+			}
+		}
+	}
+	
+	for (int i = 0; i < set->count; i++)
+	{
+		if (set->items[i].state == TRANSACTION_FAILED)
+		{
+			printNoResponse(set->items[i].request.address);
+		}
+	}
+	
+	return set->failed == 0;
+}
+
+
+//copies the answer to 'address' from a finished set into dev->response
+static int takeResponse(imu_device* dev, transaction_set* set, uint8_t address)
+{
+	transaction* t = findTransaction(set, address);
 	
-	for (int i = 0; i < n_data_bytes; i++)
+	if (t)
 	{
-		tx_packet.data[i] = data[i]; // populate packet data
-	}			
+		dev->response = t->response;
+		return 1;
+	}
+	
+	return 0;
+}
+
+
+//copies one register of a batch read into dev->response, as if it had been
+//read on its own
+static void takeRegister(imu_device* dev, uint8_t registers[][4], uint8_t first, uint8_t address)
+{
+	dev->response.address = address;
+	dev->response.n_data_bytes = 4;
+	memcpy(dev->response.data, registers[address - first], 4);
+}
+
+
+//a single request, the answer is left in dev->response
+int writeRegister(imu_device* dev, uint8_t address, uint8_t n_data_bytes, uint8_t *data)
+{
+	transaction_set set;
+	
+	initTransactions(&set);
+	addTransaction(&set, address, n_data_bytes, data);
 	
-	txPacket(&tx_packet);
+	return runTransactions(dev, &set) && takeResponse(dev, &set, address);
+}
+
+
+//reads back a single register (or the data returned by a command) into 'data'
+int readRegister(imu_device* dev, uint8_t address, uint8_t *data)
+{
+	if (writeRegister(dev, address, 0, zero_buffer))
+	{
+		memcpy(data, dev->response.data, 4);
+		return 1;
+	}
 	
-	int i = 0;
+	return 0;
+}
+
+
+//reads 'count' consecutive registers into 'data', 4 bytes each, in batch 
+//packets of up to MAX_BATCH_REGISTERS that are all in flight together
+int readRegisters(imu_device* dev, uint8_t address, int count, uint8_t* data)
+{
+	transaction_set set;
+	initTransactions(&set);
 	
-	do 
+	for (int i = 0; i < count; i += MAX_BATCH_REGISTERS)
 	{
-		txPacket(&tx_packet);
+		int n = (count - i < MAX_BATCH_REGISTERS) ? count - i : MAX_BATCH_REGISTERS;
 		
-		usleep(0.1e6);
+		if (!addBatchTransaction(&set, address + i, n, NULL))
+		{
+			return 0;
+		}
+	}
+	
+	if (!runTransactions(dev, &set))
+	{
+		return 0;
+	}
+	
+	for (int i = 0; i < set.count; i++)
+	{
+		transaction* t = &set.items[i];
+		int n = (t->request.packet_type & PT_IS_BATCH) ? (t->request.packet_type >> 2) & 0x0F : 1;
 		
-		if (i++ == TX_PACKET_ATTEMPTS)
+		memcpy(&data[4*(t->request.address - address)], t->response.data, 4*n);
+	}
+	
+	return 1;
+}
+
+
+//writes 'count' consecutive registers from 'data' in batch packets
+int writeRegisters(imu_device* dev, uint8_t address, int count, const uint8_t* data)
+{
+	transaction_set set;
+	initTransactions(&set);
+	
+	for (int i = 0; i < count; i += MAX_BATCH_REGISTERS)
+	{
+		int n = (count - i < MAX_BATCH_REGISTERS) ? count - i : MAX_BATCH_REGISTERS;
+		
+		if (!addBatchTransaction(&set, address + i, n, &data[4*i]))
 		{
-			cprint("[!!] ", BRIGHT, RED);
-			printf("No response from ");
-			
-			switch (tx_packet.address)
+			return 0;
+		}
+	}
+	
+	return runTransactions(dev, &set);
+}
+
+
+//saves every configuration register as one line of address and bytes in hex
+int dumpConfiguration(imu_device* dev, const char* path)
+{
+	uint8_t registers[CONFIG_REGISTERS][4];
+	
+	if (!readRegisters(dev, CREG_COM_SETTINGS, CONFIG_REGISTERS, registers[0]))
+	{
+		return 0;
+	}
+	
+	FILE* file = fopen(path, "w");
+	
+	if (!file)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not create %s.\n", path);
+		return 0;
+	}
+	
+	fprintf(file, "# UM7 configuration: register address, then its four bytes\n");
+	
+	for (int i = 0; i < CONFIG_REGISTERS; i++)
+	{
+		fprintf(file, "%02x %02x %02x %02x %02x\n", i, registers[i][0], registers[i][1], registers[i][2], registers[i][3]);
+	}
+	
+	fclose(file);
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Saved configuration to %s.\n", path);
+	
+	return 1;
+}
+
+
+//writes back a dump from dumpConfiguration, each run of consecutive 
+//registers goes out in batch packets. CREG_COM_SETTINGS is left alone, 
+//the baud rate belongs to the rate profile and the host end of the link.
+int restoreConfiguration(imu_device* dev, const char* path)
+{
+	uint8_t registers[CONFIG_REGISTERS][4];
+	int is_present[CONFIG_REGISTERS] = {0};
+	char line[128];
+	
+	FILE* file = fopen(path, "r");
+	
+	if (!file)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", path);
+		return 0;
+	}
+	
+	while (fgets(line, sizeof(line), file))
+	{
+		unsigned int address, b[4];
+		
+		if (line[0] == '#' || sscanf(line, "%x %x %x %x %x", &address, &b[0], &b[1], &b[2], &b[3]) != 5)
+		{
+			continue;
+		}
+		
+		if (address < CONFIG_REGISTERS && address != CREG_COM_SETTINGS)
+		{
+			for (int i = 0; i < 4; i++)
 			{
-				case CREG_COM_SETTINGS: 
-					printf("CREG_COM_SETTINGS.\n");
-					break;
-				case CREG_COM_RATES1: 
-					printf("CREG_COM_RATES1.\n");
-					break;	
-				case CREG_COM_RATES2:
-					printf("CREG_COM_RATES2.\n");
-					break;	
-				case CREG_COM_RATES3:
-					printf("CREG_COM_RATES3.\n");
-					break;	
-				case CREG_COM_RATES4:
-					printf("CREG_COM_RATES4.\n");
-					break;
-				case CREG_COM_RATES5:	
-					printf("CREG_COM_RATES5.\n");
-					break;
-				case CREG_COM_RATES6:
-					printf("CREG_COM_RATES6.\n");
-					break;
-				case CREG_COM_RATES7:
-					printf("CREG_COM_RATES7.\n");
-					break;
-				case CREG_MISC_SETTINGS:
-					printf("CREG_MISC_SETTINGS.\n");
-					break;
-				case DREG_HEALTH:
-					printf("DREG_HEALTH.\n");
-					break;
-				case RESET_EKF:
-					printf("RESET_EKF.\n");
-					break;
-				case RESET_TO_FACTORY:
-					printf("RESET_TO_FACTORY.\n");
-					break;
-				case GET_FW_REVISION:
-					printf("GET_FW_REVISION.\n");
-					break;
-				default:
-					printf("UM7_R%i.\n", tx_packet.address);
-					break;
+				registers[address][i] = b[i];
 			}
+			
+			is_present[address] = 1;
+		}
+	}
 	
-			return 0;
+	fclose(file);
+	
+	int is_ok = 1;
+	
+	for (int start = 0; start < CONFIG_REGISTERS; )
+	{
+		if (!is_present[start])
+		{
+			start++;
+			continue;
 		}
-	} while(rxPacket(address, 1) != 1);
+		
+		int end = start;
+		
+		while (end < CONFIG_REGISTERS && is_present[end])
+		{
+			end++;
+		}
+		
+		is_ok &= writeRegisters(dev, start, end - start, registers[start]);
+		start = end;
+	}
 	
-	return 1;
+	if (is_ok)
+	{
+		cprint("[OK] ", BRIGHT, GREEN);
+		printf("Restored configuration from %s.\n", path);
+	}
+	
+	return is_ok;
 }
 
 
-int writeCommand(int command)
+int writeCommand(imu_device* dev, int command)
 {
-	if (writeRegister(command, 0, zero_buffer))
+	if (writeRegister(dev, command, 0, zero_buffer))
 	{
-		if (global_packet.packet_type & PT_CF)
+		if (dev->response.packet_type & PT_CF)
 		{
 			cprint("[!!] ", BRIGHT, RED);
 			printf("%i Error.\n", command);
@@ -393,92 +512,75 @@ int writeCommand(int command)
 }
 
 
-void getHeartbeat(void)
+//one read of the health register, answered by the next broadcast if health 
+//is being broadcast already. Only for use before a capture: once streaming,
+//processUART decodes every health packet as it passes.
+int getHeartbeat(imu_device* dev)
 {
-	//wait until valid health packet is received
-	while(rxPacket(DREG_HEALTH, 1) != 1)
+	uint8_t data[4];
+	
+	if (!readRegister(dev, DREG_HEALTH, data))
 	{
-		usleep(1e3);
+		return 0;
 	}
 	
-	uint32_t health_reg = bit8ArrayToBit32(global_packet.data);
-	beat.sats_used = 0;
-	beat.sats_view = 0;
+	decodeHealth(bit8ArrayToBit32(data), &dev->beat);
 	
-	beat.gps_fail = checkBit(health_reg, 0);
-	beat.mag_fail = checkBit(health_reg, 1);
-	beat.gyro_fail = checkBit(health_reg, 2);
-	beat.acc_fail = checkBit(health_reg, 3);
-	beat.acc_norm = checkBit(health_reg, 4);
-	beat.mag_norm = checkBit(health_reg, 5);
-	beat.uart_fail = checkBit(health_reg, 8);
-	
-	for (int i = 0; i < 6; i++)
-	{
-		if (health_reg & (uint32_t)(1 << (10 + i)))
-		{
-			beat.sats_view += pow(2, i);
-		}
-		
-		if (health_reg & (uint32_t)(1 << (26 + i)))
-		{
-			beat.sats_used += pow(2, i);
-		}
-	}
+	return 1;
 }
 
 
-void printHeartbeat(void)
+void printHeartbeat(const heartbeat* beat)
 {
-	/*if (beat.gps_fail) 
+	/*if (beat->gps_fail) 
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("No GPS data for 2 seconds.\n");
 	}
 	
-	if (beat.mag_fail) 
+	if (beat->mag_fail) 
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("Mag failed to init on startup.\n");
 	}		
 	
-	if (beat.gyro_fail)
+	if (beat->gyro_fail)
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("Gyro failed to init on startup.\n");
 	}	
  
-	if (beat.acc_fail) 
+	if (beat->acc_fail) 
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("Acc failed to init on startup.\n");
 	}		
 	
-	if (beat.acc_norm) 
+	if (beat->acc_norm) 
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("Acc norm exceeded - aggressive acceleration detected.\n");
 	}	
 	
-	if (beat.mag_norm) 
+	if (beat->mag_norm) 
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("Mag norm exceeded - bad calibration.\n");
 	}
 	
-	if (beat.uart_fail)
+	if (beat->uart_fail)
 	{
 		cprint("[**] ", BRIGHT, RED);
 		printf("UART overflow - reduce broadcast rates.\n");
 	}		
 	
 	cprint("[**] ", BRIGHT, CYAN);
-	printf("Satellites in view: %i\n", beat.sats_view);	
+	printf("Satellites in view: %i\n", beat->sats_view);	
 
 	cprint("[**] ", BRIGHT, CYAN);
-	printf("Satellites in use: %i\n", beat.sats_used);*/
+	printf("Satellites in use: %i\n", beat->sats_used);*/
 
-	int imu_sum = (beat.mag_fail + beat.mag_fail + beat.gyro_fail + beat.acc_fail + beat.acc_norm + beat.mag_norm);
+	int imu_sum = (beat->mag_fail + beat->mag_fail + beat->gyro_fail + beat->acc_fail + beat->acc_norm + beat->mag_norm);
 	
 	char ok[20];
 	char no[20];
@@ -486,149 +588,135 @@ void printHeartbeat(void)
 	ctext(ok, "OK", BRIGHT, GREEN);
 	ctext(no, "NO", BRIGHT, RED);
 	
-	char* gps_status  = (beat.gps_fail)  ? no : ok;
-	char* uart_status = (beat.uart_fail) ? no : ok;
+	char* gps_status  = (beat->gps_fail)  ? no : ok;
+	char* uart_status = (beat->uart_fail) ? no : ok;
 	char* imu_status  = (imu_sum)        ? no : ok;
 	
 	printf("---------------------------\n");
 	printf("| GPS | IMU | UART | SATS |\n");
 	printf("---------------------------\n");
-	printf("| %s  | %s  | %s   | %i/%2i |\n", gps_status, imu_status, uart_status, beat.sats_used, beat.sats_view);	
+	printf("| %s  | %s  | %s   | %i/%2i |\n", gps_status, imu_status, uart_status, beat->sats_used, beat->sats_view);	
 	printf("---------------------------\n");
 	
 }
 
 
-void printHome(void)
+void printHome(imu_device* dev)
 {
-	if (writeRegister(CREG_HOME_NORTH, 0, zero_buffer))
+	uint8_t home[3][4];
+	
+	if (readRegisters(dev, CREG_HOME_NORTH, 3, home[0]))
 	{
 		cprint("[**] ", BRIGHT, CYAN);
-		printf("Latitude: \t%f\n", bit8ArrayToFloat(global_packet.data));
-	}
+		printf("Latitude: \t%f\n", bit8ArrayToFloat(home[0]));
 		
-	if (writeRegister(CREG_HOME_EAST, 0, zero_buffer))
-	{
 		cprint("[**] ", BRIGHT, CYAN);
-		printf("Longitude: %f\n", bit8ArrayToFloat(global_packet.data));
-	}
-	
-	if (writeRegister(CREG_HOME_UP, 0, zero_buffer))
-	{
+		printf("Longitude: %f\n", bit8ArrayToFloat(home[1]));
+		
 		cprint("[**] ", BRIGHT, CYAN);
-		printf("Altitude: \t%f\n", bit8ArrayToFloat(global_packet.data));
+		printf("Altitude: \t%f\n", bit8ArrayToFloat(home[2]));
 	}
 }
 
 
-void printRegister(uint8_t address)
+void printRegister(imu_device* dev, uint8_t address)
 {
-	if (writeRegister(address, 0, zero_buffer))
+	if (writeRegister(dev, address, 0, zero_buffer))
 	{
-		printf("UM7_R%i: ", global_packet.address);
+		printf("UM7_R%i: ", dev->response.address);
 		for (int i = 0; i < 4; i++)
-			printf(" %i", global_packet.data[i]);
+			printf(" %i", dev->response.data[i]);
 		printf("\n");
 	}
 }
 
 
-void printConfiguration(void)
+void printConfiguration(imu_device* dev)
 {
-	printf("\n");
+	uint8_t config[CREG_MISC_SETTINGS + 1][4];
 	
-	if (writeRegister(CREG_COM_SETTINGS, 0, zero_buffer))
+	//all nine configuration registers in one batch packet
+	if (!readRegisters(dev, CREG_COM_SETTINGS, CREG_MISC_SETTINGS + 1, config[0]))
 	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_SETTINGS (%i):\n", global_packet.address);
-		printf("baud_rate: \t%i\n", (global_packet.data[0] & 0b11110000) >> 4);
-		printf("gps_baud: \t%i\n", (global_packet.data[0] & 0b00001111) >> 0);
-		printf("gps_auto: \t%i\n", checkBit(global_packet.data[2], 0));
-		printf("sat_auto: \t%i\n", checkBit(global_packet.data[3], 4));
-		printf("\n");
+		return;
 	}
 	
-	if (writeRegister(CREG_COM_RATES1, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES1 (%i):\n", global_packet.address);
-		printf("raw_acc_rate: \t%i\n", 	global_packet.data[0]);
-		printf("raw_gyro_rate: \t%i\n", global_packet.data[1]);
-		printf("raw_mag_rate: \t%i\n", 	global_packet.data[2]);
-		printf("\n");
-	}
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES2, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES2 (%i):\n", global_packet.address);
-		printf("temp_rate: \t%i\n", 	global_packet.data[0]);
-		printf("all_raw_rate: \t%i\n", 	global_packet.data[3]);
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_SETTINGS);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_SETTINGS (%i):\n", dev->response.address);
+	printf("baud_rate: \t%i\n", (dev->response.data[0] & 0b11110000) >> 4);
+	printf("gps_baud: \t%i\n", (dev->response.data[0] & 0b00001111) >> 0);
+	printf("gps_auto: \t%i\n", checkBit(dev->response.data[2], 0));
+	printf("sat_auto: \t%i\n", checkBit(dev->response.data[3], 4));
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES3, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES3 (%i):\n", global_packet.address);
-		printf("proc_acc_rate: \t%i\n", global_packet.data[0]);
-		printf("proc_gyro_rate: %i\n", 	global_packet.data[1]);
-		printf("proc_mag_rate: \t%i\n", global_packet.data[2]);
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES1);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES1 (%i):\n", dev->response.address);
+	printf("raw_acc_rate: \t%i\n", 	dev->response.data[0]);
+	printf("raw_gyro_rate: \t%i\n", dev->response.data[1]);
+	printf("raw_mag_rate: \t%i\n", 	dev->response.data[2]);
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES4, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES4 (%i):\n", global_packet.address);
-		printf("all_proc_rate: \t%i\n", global_packet.data[3]);
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES2);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES2 (%i):\n", dev->response.address);
+	printf("temp_rate: \t%i\n", 	dev->response.data[0]);
+	printf("all_raw_rate: \t%i\n", 	dev->response.data[3]);
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES5, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES5 (%i):\n", global_packet.address);
-		printf("quat_rate: \t%i\n", 	global_packet.data[0]);
-		printf("euler_rate: \t%i\n", 	global_packet.data[1]);
-		printf("position_rate: \t%i\n", global_packet.data[2]);
-		printf("velocity_rate: \t%i\n", global_packet.data[3]);
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES3);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES3 (%i):\n", dev->response.address);
+	printf("proc_acc_rate: \t%i\n", dev->response.data[0]);
+	printf("proc_gyro_rate: %i\n", 	dev->response.data[1]);
+	printf("proc_mag_rate: \t%i\n", dev->response.data[2]);
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES6, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES6 (%i):\n", global_packet.address);
-		printf("pose_rate: \t%i\n", global_packet.data[0]);
-		printf("health_rate: \t%i\n", (global_packet.data[1] & 0b00001111));
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES4);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES4 (%i):\n", dev->response.address);
+	printf("all_proc_rate: \t%i\n", dev->response.data[3]);
+	printf("\n");
 	
-	if (writeRegister(CREG_COM_RATES7, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_COM_RATES7 (%i):\n", global_packet.address);
-		printf("health_rate: \t%i\n", 	(global_packet.data[0] & 0b11110000) >> 4);
-		printf("pose_rate: \t%i\n", 	(global_packet.data[0] & 0b00001111) >> 0);
-		printf("attitude_rate: \t%i\n", (global_packet.data[1] & 0b11110000) >> 4);
-		printf("sensor_rate: \t%i\n", 	(global_packet.data[1] & 0b00001111) >> 0);
-		printf("rates_rate: \t%i\n", 	(global_packet.data[2] & 0b11110000) >> 4);
-		printf("gps_pose_rate: \t%i\n", (global_packet.data[2] & 0b00001111) >> 0);
-		printf("quat_rate: \t%i\n", 	(global_packet.data[3] & 0b11110000) >> 4);
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES5);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES5 (%i):\n", dev->response.address);
+	printf("quat_rate: \t%i\n", 	dev->response.data[0]);
+	printf("euler_rate: \t%i\n", 	dev->response.data[1]);
+	printf("position_rate: \t%i\n", dev->response.data[2]);
+	printf("velocity_rate: \t%i\n", dev->response.data[3]);
+	printf("\n");
 	
-	if (writeRegister(CREG_MISC_SETTINGS, 0, zero_buffer))
-	{
-		cprint("[**] ", BRIGHT, CYAN);
-		printf("CREG_MISC_SETTINGS (%i):\n", global_packet.address);
-		printf("pps: \t\t%s\n", 		checkBit(global_packet.data[2], 0) ? "enabled" : "disabled");
-		printf("gyro_bias: \t%s\n", 	checkBit(global_packet.data[3], 2) ? "enabled" : "disabled");
-		printf("quaternion: \t%s\n", 	checkBit(global_packet.data[3], 1) ? "enabled" : "disabled");
-		printf("mag_state: \t%s\n", 	checkBit(global_packet.data[3], 0) ? "enabled" : "disabled");
-		printf("\n");
-	}
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES6);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES6 (%i):\n", dev->response.address);
+	printf("pose_rate: \t%i\n", dev->response.data[0]);
+	printf("health_rate: \t%i\n", (dev->response.data[1] & 0b00001111));
+	printf("\n");
+	
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_COM_RATES7);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_COM_RATES7 (%i):\n", dev->response.address);
+	printf("health_rate: \t%i\n", 	(dev->response.data[0] & 0b11110000) >> 4);
+	printf("pose_rate: \t%i\n", 	(dev->response.data[0] & 0b00001111) >> 0);
+	printf("attitude_rate: \t%i\n", (dev->response.data[1] & 0b11110000) >> 4);
+	printf("sensor_rate: \t%i\n", 	(dev->response.data[1] & 0b00001111) >> 0);
+	printf("rates_rate: \t%i\n", 	(dev->response.data[2] & 0b11110000) >> 4);
+	printf("gps_pose_rate: \t%i\n", (dev->response.data[2] & 0b00001111) >> 0);
+	printf("quat_rate: \t%i\n", 	(dev->response.data[3] & 0b11110000) >> 4);
+	printf("\n");
+	
+	takeRegister(dev, config, CREG_COM_SETTINGS, CREG_MISC_SETTINGS);
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("CREG_MISC_SETTINGS (%i):\n", dev->response.address);
+	printf("pps: \t\t%s\n", 		checkBit(dev->response.data[2], 0) ? "enabled" : "disabled");
+	printf("gyro_bias: \t%s\n", 	checkBit(dev->response.data[3], 2) ? "enabled" : "disabled");
+	printf("quaternion: \t%s\n", 	checkBit(dev->response.data[3], 1) ? "enabled" : "disabled");
+	printf("mag_state: \t%s\n", 	checkBit(dev->response.data[3], 0) ? "enabled" : "disabled");
+	printf("\n");
 }
 
 
@@ -648,18 +736,21 @@ void list_ports(void)
 }
 
 
-int getUART(void)
+int getUART(imu_device* dev)
 {
 	int bytes_read = 0;
-	int bytes_waiting = sp_input_waiting(port);
+	int bytes_waiting = sp_input_waiting(dev->port);
+	
+	if (bytes_waiting > UART_BYTE_BUFFER)
+	{
+		bytes_waiting = UART_BYTE_BUFFER;
+	}
 	
 	if (bytes_waiting > 0) 
 	{
 		//printf("Bytes waiting %i\n", bytes_waiting);	
-
-		memset(byte_buffer, 0, bytes_waiting*sizeof(uint8_t));
 		
-		bytes_read = sp_nonblocking_read(port, byte_buffer, bytes_waiting);
+		bytes_read = sp_nonblocking_read(dev->port, dev->byte_buffer, bytes_waiting);
 		
 		if (bytes_read < 0)
 		{
@@ -671,28 +762,101 @@ int getUART(void)
 }
 
 
-void initUART(void)
+static long elapsedMicroseconds(struct timespec* from, struct timespec* to)
 {
-	if (sp_get_port_by_name(UART_PORT, &port) == SP_OK) 
+	return (to->tv_sec - from->tv_sec)*1000000L + (to->tv_nsec - from->tv_nsec)/1000L;
+}
+
+
+//blocks on the serial file descriptor until at least 'low_water' bytes are 
+//waiting or 'timeout_ms' has passed, then reads whatever is available
+int waitUART(imu_device* dev, int low_water, int timeout_ms)
+{
+	struct timespec start, now;
+	long timeout_us = timeout_ms*1000L;
+	
+	if (low_water > UART_BYTE_BUFFER)
+	{
+		low_water = UART_BYTE_BUFFER;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	while (1)
+	{
+		int bytes_waiting = sp_input_waiting(dev->port);
+		
+		if (bytes_waiting < 0)
+		{
+			printf("Error reading from UART.\n");
+			exit(EXIT_FAILURE);
+		}
+		
+		if (bytes_waiting >= low_water)
+		{
+			break;
+		}
+		
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long remaining_us = timeout_us - elapsedMicroseconds(&start, &now);
+		
+		if (remaining_us <= 0)
+		{
+			break;
+		}
+		
+		if (bytes_waiting == 0)
+		{
+			//nothing received yet, sleep in the kernel until the first byte arrives
+			struct pollfd uart_poll = {dev->fd, POLLIN, 0};
+			
+			if (poll(&uart_poll, 1, (remaining_us + 999)/1000) == 0)
+			{
+				break;
+			}
+		}
+		else
+		{
+			//data is arriving, sleep for as long as the missing bytes take on the wire
+			long fill_us = (long)(low_water - bytes_waiting)*(UART_BITS + UART_STOPBITS + 1)*1000000L/dev->baud_rate;
+			
+			if (fill_us > remaining_us)
+			{
+				fill_us = remaining_us;
+			}
+			
+			usleep(fill_us);
+		}
+	}
+	
+	return getUART(dev);
+}
+
+
+//'port_name' is normally UART_PORT, or the pty of the UM7 simulator
+void initUART(imu_device* dev, const char* port_name, int baud_rate)
+{
+	if (sp_get_port_by_name(port_name, &dev->port) == SP_OK) 
 	{		
-		if (sp_open(port, SP_MODE_READ_WRITE) == SP_OK)
+		if (sp_open(dev->port, SP_MODE_READ_WRITE) == SP_OK)
 		{
 			cprint("[OK] ", BRIGHT, GREEN);
-			printf("Opened serial port: %s.\n", sp_get_port_name(port));
+			printf("Opened serial port: %s.\n", sp_get_port_name(dev->port));
 			
-			sp_new_config(&port_config);
-			sp_set_config_baudrate(port_config, UART_BAUD_RATE);
-			sp_set_config_bits(port_config, UART_BITS);
-			sp_set_config_parity(port_config, SP_PARITY_NONE);
-			sp_set_config_stopbits(port_config, UART_STOPBITS);
-			sp_set_config_rts(port_config, SP_RTS_OFF);
-			sp_set_config_cts(port_config, SP_CTS_IGNORE);
-			sp_set_config_dtr(port_config, SP_DTR_OFF);
-			sp_set_config_dsr(port_config, SP_DSR_IGNORE);
-			sp_set_config_xon_xoff(port_config, SP_XONXOFF_DISABLED);
-			sp_set_config_flowcontrol(port_config, SP_FLOWCONTROL_NONE);
+			sp_new_config(&dev->port_config);
+			dev->baud_rate = baud_rate;
+			sp_set_config_baudrate(dev->port_config, dev->baud_rate);
+			sp_set_config_bits(dev->port_config, UART_BITS);
+			sp_set_config_parity(dev->port_config, SP_PARITY_NONE);
+			sp_set_config_stopbits(dev->port_config, UART_STOPBITS);
+			sp_set_config_rts(dev->port_config, SP_RTS_OFF);
+			sp_set_config_cts(dev->port_config, SP_CTS_IGNORE);
+			sp_set_config_dtr(dev->port_config, SP_DTR_OFF);
+			sp_set_config_dsr(dev->port_config, SP_DSR_IGNORE);
+			sp_set_config_xon_xoff(dev->port_config, SP_XONXOFF_DISABLED);
+			sp_set_config_flowcontrol(dev->port_config, SP_FLOWCONTROL_NONE);
 			
-			if (sp_set_config(port, port_config) == SP_OK)
+			if (sp_set_config(dev->port, dev->port_config) == SP_OK && sp_get_port_handle(dev->port, &dev->fd) == SP_OK)
 			{
 				cprint("[OK] ", BRIGHT, GREEN);
 				printf("Serial port configured.\n");
@@ -719,9 +883,113 @@ void initUART(void)
 }
 
 
-void dnitUART(void)
+//changes the host side of the link, unparsed bytes at the old rate are dropped
+int setBaudRate(imu_device* dev, int baud_rate)
+{
+	sp_set_config_baudrate(dev->port_config, baud_rate);
+	
+	if (sp_set_config(dev->port, dev->port_config) != SP_OK)
+	{
+		return 0;
+	}
+	
+	sp_flush(dev->port, SP_BUF_INPUT);
+	initParser(&dev->uart_parser);
+	dev->baud_rate = baud_rate;
+	
+	return 1;
+}
+
+
+//hands every packet in 'bytes_read' fresh bytes of the buffer to the log
+//queue and the decoder, then publishes the new state once. 'timestamp' is
+//when the read returned. Returns the number of packets.
+int processUART(imu_device* dev, int bytes_read, uint64_t timestamp)
+{
+	packet rx_packet;
+	device_metrics* metrics = dev->metrics;
+	uint64_t byte_time = uartByteTime(dev);
+	uint64_t newest = 0;
+	uint32_t updated = 0;
+	int packets = 0;
+	
+	parserPush(&dev->uart_parser, dev->byte_buffer, bytes_read);
+	
+	while (parserNext(&dev->uart_parser, &rx_packet))
+	{
+		//the stamp belongs to the last byte read, a packet further back in 
+		//the read finished arriving one byte time per byte behind it earlier.
+		//An adapter that delivers a burst breaks that, so a stamp is never
+		//put before the previous packet's. The aligned stamp keeps the fit.
+		uint64_t line_rate = parserPending(&dev->uart_parser)*byte_time;
+		
+		rx_packet.timestamp = (timestamp > line_rate) ? timestamp - line_rate : 0;
+		rx_packet.timestamp = (rx_packet.timestamp > dev->last_stamp) ? rx_packet.timestamp : dev->last_stamp;
+		dev->last_stamp = rx_packet.timestamp;
+		
+		uint32_t decoded = decodePacket(&rx_packet, &dev->state);
+		stampSamples(&dev->align, &dev->state, decoded, rx_packet.timestamp);
+		rx_packet.decoded = hostTime();
+		
+		//faults are found as health packets stream past, the log writer
+		//records the transition next to the packet
+		rx_packet.health_changed = (decoded & DECODED_HEALTH) ? updateHealth(&dev->health, &dev->state.health) : 0;
+		
+		if (rx_packet.health_changed)
+		{
+			addCounter(&metrics->health_transitions, 1);
+		}
+		
+		recordHistogram(&metrics->arrival_to_decode, rx_packet.decoded - rx_packet.timestamp);
+		queuePush(&dev->queue, &rx_packet);
+		
+		if (dev->ring && decoded)
+		{
+			publishSample(dev->ring, dev->index, decoded, rx_packet.timestamp, rx_packet.decoded, &dev->state);
+		}
+		
+		updated |= decoded;
+		newest = rx_packet.timestamp;
+		packets++;
+	}
+	
+	//one publish per read, readers see every packet of it at once
+	if (updated)
+	{
+		publishSnapshot(&dev->latest, &dev->state, newest);
+		
+		if (dev->ring)
+		{
+			notifyRing(dev->ring);
+		}
+	}
+	
+	if (bytes_read > 0)
+	{
+		addCounter(&metrics->reads, 1);
+		addCounter(&metrics->bytes, bytes_read);
+		addCounter(&metrics->packets, packets);
+		setCounter(&metrics->checksum_errors, dev->uart_parser.checksum_errors);
+		setCounter(&metrics->skipped_bytes, dev->uart_parser.skipped_bytes);
+		setCounter(&metrics->dropped_bytes, dev->uart_parser.dropped_bytes);
+		setCounter(&metrics->queue_depth, queueOccupancy(&dev->queue));
+		setCounter(&metrics->queue_high_water, dev->queue.high_water);
+		setCounter(&metrics->queue_dropped, dev->queue.dropped);
+	}
+	
+	return packets;
+}
+
+
+uint64_t uartByteTime(imu_device* dev)
+{
+	return (UART_BITS + UART_STOPBITS + 1)*1000000000ULL/dev->baud_rate;
+}
+
+
+void dnitUART(imu_device* dev)
 {
-	sp_close(port);
+	sp_close(dev->port);
 }
 
 
@@ -0,0 +1,445 @@
+#include "log.h"
+
+void initLogHeader(log_header* header)
+{
+	memset(header, 0, sizeof(log_header));
+	memcpy(header->magic, LOG_MAGIC, sizeof(header->magic));
+	
+	header->version = LOG_VERSION;
+	header->header_size = sizeof(log_header);
+	header->sync_interval = LOG_SYNC_INTERVAL;
+	header->start_wall = wallTime();
+	header->start_host = hostTime();
+}
+
+
+uint16_t logChecksum(const log_record* record, const uint8_t* payload)
+{
+	const uint8_t* bytes = (const uint8_t*)record;
+	uint16_t checksum = 0;
+	
+	for (int i = 0; i < sizeof(log_record); i++)
+	{
+		checksum += bytes[i];
+	}
+	
+	for (int i = 0; i < record->length; i++)
+	{
+		checksum += payload[i];
+	}
+	
+	return checksum;
+}
+
+
+//adler-32 with the modulo deferred as far as it can go
+uint32_t blockChecksum(const uint8_t* data, uint32_t length)
+{
+	uint32_t a = 1, b = 0;
+	
+	while (length > 0)
+	{
+		uint32_t n = (length < 5552) ? length : 5552;
+		
+		length -= n;
+		
+		while (n--)
+		{
+			a += *data++;
+			b += a;
+		}
+		
+		a %= 65521;
+		b %= 65521;
+	}
+	
+	return (b << 16) | a;
+}
+
+
+void initLogHistory(log_history* history)
+{
+	history->sequence = 0;
+	history->timestamp = 0;
+	memset(history->length, 0, sizeof(history->length));
+}
+
+
+static uint8_t* putVarint(uint8_t* p, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = value | 0x80;
+		value >>= 7;
+	}
+	
+	*p++ = value;
+	
+	return p;
+}
+
+
+static void flushBlock(log_writer* log)
+{
+	log_block* block = log->block;
+	
+	if (block->header.records == 0)
+	{
+		return;
+	}
+	
+	uint32_t plain_size = block->header.plain_size;
+	uint32_t packed_size = lzCompress(block->plain, plain_size, block->packed, block->hash);
+	const uint8_t* body = block->packed;
+	
+	//random data does not shrink, keep it as it is
+	if (packed_size >= plain_size)
+	{
+		packed_size = plain_size;
+		body = block->plain;
+	}
+	
+	memcpy(block->header.magic, LOG_BLOCK_MAGIC, sizeof(block->header.magic));
+	block->header.packed_size = packed_size;
+	block->header.checksum = blockChecksum(block->plain, plain_size);
+	
+	if (!writeBlockFile(&log->file, &block->header, sizeof(log_block_header)) || !writeBlockFile(&log->file, body, packed_size))
+	{
+		log->write_errors++;
+	}
+	
+	if (log->index)
+	{
+		log_index_entry entry = {block->header.first_timestamp, log->packed_bytes};
+		fwrite(&entry, sizeof(log_index_entry), 1, log->index);
+	}
+	
+	log->packed_bytes += sizeof(log_block_header) + packed_size;
+	
+	memset(&block->header, 0, sizeof(log_block_header));
+	initLogHistory(&block->history);
+}
+
+
+static void packRecord(log_writer* log, const log_record* record, const uint8_t* payload)
+{
+	log_block* block = log->block;
+	log_history* history = &block->history;
+	
+	if (block->header.plain_size + LOG_PACKED_RECORD_MAX > LOG_BLOCK_SIZE)
+	{
+		flushBlock(log);
+	}
+	
+	if (block->header.records == 0)
+	{
+		block->header.first_timestamp = record->timestamp;
+	}
+	
+	uint8_t* p = &block->plain[block->header.plain_size];
+	int64_t time_delta = record->timestamp - history->timestamp;
+	
+	*p++ = record->kind;
+	*p++ = record->length;
+	*p++ = record->address;
+	*p++ = record->packet_type;
+	p = putVarint(p, (uint32_t)(record->sequence - history->sequence));
+	p = putVarint(p, ((uint64_t)time_delta << 1) ^ (uint64_t)(time_delta >> 63));
+	
+	history->sequence = record->sequence;
+	history->timestamp = record->timestamp;
+	
+	//successive samples of a register share most of their high bytes
+	if (record->kind == LOG_PACKET && record->length <= MAX_PACKET_DATA)
+	{
+		uint8_t* previous = history->data[record->address];
+		int is_delta = (history->length[record->address] == record->length);
+		
+		for (int i = 0; i < record->length; i++)
+		{
+			p[i] = is_delta ? payload[i] ^ previous[i] : payload[i];
+		}
+		
+		memcpy(previous, payload, record->length);
+		history->length[record->address] = record->length;
+	}
+	else
+	{
+		memcpy(p, payload, record->length);
+	}
+	
+	p += record->length;
+	
+	block->header.plain_size = p - block->plain;
+	block->header.log_size += LOG_RECORD_OVERHEAD + record->length;
+	block->header.records++;
+}
+
+
+static void writeRecord(log_writer* log, const log_record* record, const uint8_t* payload)
+{
+	if (log->block)
+	{
+		packRecord(log, record, payload);
+		log->bytes_written += LOG_RECORD_OVERHEAD + record->length;
+		return;
+	}
+	
+	uint16_t checksum = logChecksum(record, payload);
+	
+	if (!writeBlockFile(&log->file, record, sizeof(log_record)) || !writeBlockFile(&log->file, payload, record->length) || 
+		!writeBlockFile(&log->file, &checksum, sizeof(uint16_t)))
+	{
+		log->write_errors++;
+	}
+	
+	log->bytes_written += LOG_RECORD_OVERHEAD + record->length;
+}
+
+
+void initLogOptions(log_options* options)
+{
+	memset(options, 0, sizeof(log_options));
+	options->sync_interval = LOG_FSYNC_INTERVAL;
+}
+
+
+//path of the current part, the part number goes before the extension
+static void partPath(const log_writer* log, char* path, size_t size)
+{
+	const char* extension = strrchr(log->path, '.');
+	
+	if (!log->options.rotate_size && !log->options.rotate_time)
+	{
+		snprintf(path, size, "%s", log->path);
+	}
+	else if (extension)
+	{
+		snprintf(path, size, "%.*s.%03u%s", (int)(extension - log->path), log->path, log->part, extension);
+	}
+	else
+	{
+		snprintf(path, size, "%s.%03u", log->path, log->part);
+	}
+}
+
+
+static int openPart(log_writer* log)
+{
+	char path[LOG_PATH_SIZE];
+	log_header header = log->header;
+	
+	partPath(log, path, sizeof(path));
+	
+	if (!openBlockFile(&log->file, path, log->options.is_direct))
+	{
+		return 0;
+	}
+	
+	log->file.write_times = log->options.write_times;
+	log->file.sync_times = log->options.sync_times;
+	log->opened = hostTime();
+	
+	//every part can be read on its own, its times count from when it began
+	if (log->part > 0)
+	{
+		header.start_wall = wallTime();
+		header.start_host = log->opened;
+	}
+	
+	if (log->options.is_packed)
+	{
+		memcpy(header.magic, LOG_PACKED_MAGIC, sizeof(header.magic));
+		initLogHistory(&log->block->history);
+	}
+	
+	writeBlockFile(&log->file, &header, sizeof(log_header));
+	
+	log->bytes_written = sizeof(log_header);
+	log->packed_bytes = sizeof(log_header);
+	
+	//the index is a convenience for readers, the log is still usable without it
+	char index_path[LOG_PATH_SIZE + 4];
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	
+	if ((log->index = fopen(index_path, "wb")))
+	{
+		log_index_header index_header;
+		memcpy(index_header.magic, (log->block) ? LOG_BLOCK_INDEX_MAGIC : LOG_INDEX_MAGIC, sizeof(index_header.magic));
+		index_header.start_host = header.start_host;
+		
+		fwrite(&index_header, sizeof(log_index_header), 1, log->index);
+	}
+	
+	//the first sync goes in with the first packet and takes its stamp, the
+	//packets queued before the open were stamped earlier than it
+	log->records_since_sync = LOG_SYNC_INTERVAL;
+	
+	return 1;
+}
+
+
+static void closePart(log_writer* log)
+{
+	if (log->block)
+	{
+		flushBlock(log);
+	}
+	
+	if (!closeBlockFile(&log->file))
+	{
+		log->write_errors++;
+	}
+	
+	if (log->index)
+	{
+		fclose(log->index);
+		log->index = NULL;
+	}
+}
+
+
+int openLogWith(log_writer* log, const char* path, const log_header* header, const log_options* options)
+{
+	memset(log, 0, sizeof(log_writer));
+	
+	log->options = *options;
+	log->header = *header;
+	snprintf(log->path, sizeof(log->path), "%s", path);
+	
+	if (options->is_packed && !(log->block = calloc(1, sizeof(log_block))))
+	{
+		return 0;
+	}
+	
+	if (!openPart(log))
+	{
+		free(log->block);
+		log->block = NULL;
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+int openLog(log_writer* log, const char* path, const log_header* header)
+{
+	log_options options;
+	initLogOptions(&options);
+	
+	return openLogWith(log, path, header, &options);
+}
+
+
+//writes compressed blocks instead of plain records, readers unpack it
+int openPackedLog(log_writer* log, const char* path, const log_header* header)
+{
+	log_options options;
+	initLogOptions(&options);
+	options.is_packed = 1;
+	
+	return openLogWith(log, path, header, &options);
+}
+
+
+static void rotateLog(log_writer* log)
+{
+	closePart(log);
+	log->part++;
+	
+	if (!openPart(log))
+	{
+		log->write_errors++;
+	}
+}
+
+
+//call often, with or without new records: starts the next part when this 
+//one is full or old enough and syncs at the configured interval. A packed 
+//log compresses its partial block first so that it is covered by the sync.
+void tickLog(log_writer* log, uint64_t now)
+{
+	if (log->options.rotate_time && now - log->opened >= log->options.rotate_time)
+	{
+		rotateLog(log);
+		return;
+	}
+	
+	if (log->options.sync_interval == 0 || now - log->file.last_sync < log->options.sync_interval)
+	{
+		return;
+	}
+	
+	if (log->block)
+	{
+		flushBlock(log);
+	}
+	
+	if (log->index)
+	{
+		fflush(log->index);
+	}
+	
+	if (!syncBlockFile(&log->file))
+	{
+		log->write_errors++;
+	}
+}
+
+
+void writeLogSync(log_writer* log, uint32_t sequence, uint64_t timestamp)
+{
+	log_record record = {LOG_SYNC, 8, 0, 0, sequence, timestamp};
+	
+	//a packed log is indexed by block as each one is flushed
+	if (log->index && !log->block)
+	{
+		log_index_entry entry = {timestamp, log->bytes_written};
+		fwrite(&entry, sizeof(log_index_entry), 1, log->index);
+	}
+	
+	writeRecord(log, &record, (const uint8_t*)LOG_SYNC_MAGIC);
+	log->records_since_sync = 0;
+}
+
+
+void writeLogPacket(log_writer* log, const packet* rx_packet)
+{
+	if (log->options.rotate_size && log->bytes_written >= log->options.rotate_size)
+	{
+		rotateLog(log);
+	}
+	
+	if (log->records_since_sync == LOG_SYNC_INTERVAL)
+	{
+		writeLogSync(log, rx_packet->sequence, rx_packet->timestamp);
+	}
+	
+	log_record record = {LOG_PACKET, rx_packet->n_data_bytes, rx_packet->address, rx_packet->packet_type, rx_packet->sequence, rx_packet->timestamp};
+	
+	writeRecord(log, &record, rx_packet->data);
+	log->records_since_sync++;
+}
+
+
+//the packet itself is logged as usual, the event record follows it so that
+//readers can find transitions without decoding every packet
+void writeLogEvent(log_writer* log, const packet* rx_packet, uint32_t changed)
+{
+	uint8_t payload[MAX_PACKET_DATA + sizeof(uint32_t)];
+	log_record record = {LOG_EVENT, rx_packet->n_data_bytes + sizeof(uint32_t), rx_packet->address, rx_packet->packet_type, rx_packet->sequence, rx_packet->timestamp};
+	
+	memcpy(payload, rx_packet->data, rx_packet->n_data_bytes);
+	memcpy(&payload[rx_packet->n_data_bytes], &changed, sizeof(uint32_t));
+	
+	writeRecord(log, &record, payload);
+}
+
+
+void closeLog(log_writer* log)
+{
+	closePart(log);
+	free(log->block);
+	log->block = NULL;
+}
@@ -0,0 +1,162 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "um7.h"
+#include "clock.h"
+#include "compress.h"
+#include "blockfile.h"
+#include "histogram.h"
+
+#define LOG_MAGIC				"UM7RPLOG"
+#define LOG_INDEX_MAGIC			"UM7RPIDX"
+#define LOG_BLOCK_INDEX_MAGIC	"UM7RPBIX"
+#define LOG_SYNC_MAGIC			"UM7RSYNC"
+#define LOG_PACKED_MAGIC		"UM7RPLZ1"
+#define LOG_BLOCK_MAGIC			"UM7B"
+#define LOG_VERSION				1
+#define LOG_SYNC_INTERVAL		256		//packet records between sync markers
+#define LOG_CONFIG_REGISTERS	9		//CREG_COM_SETTINGS to CREG_MISC_SETTINGS
+#define LOG_BLOCK_SIZE			32768	//packed record bytes per compressed block
+#define LOG_PACKED_RECORD_MAX	(4 + 5 + 10 + 255)	//largest record after packing
+#define LOG_FSYNC_INTERVAL		1000000000ULL	//default ns between syncs to the media
+#define LOG_PATH_SIZE			(256 + 16)		//a path and its part number
+
+//record kinds
+#define LOG_PACKET				1
+#define LOG_SYNC				2
+#define LOG_EVENT				3
+
+//file header, written once at the start of every log
+typedef struct __attribute__((packed))
+{
+  char magic[8];
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t sync_interval;
+  uint64_t start_wall;						//wall clock at open, ns since the epoch
+  uint64_t start_host;						//host monotonic clock at open, ns
+  char firmware[4];
+  uint8_t config[LOG_CONFIG_REGISTERS][4];	//configuration registers as read from the device
+} log_header;
+
+//record header, followed by 'length' payload bytes and a 16-bit sum of the
+//header and payload bytes. Packet records carry the validated register data 
+//exactly as received, sync records carry LOG_SYNC_MAGIC so that a reader can 
+//skip a corrupted region by scanning for it. Event records carry the register
+//data that caused the event followed by a 32-bit mask of what changed.
+typedef struct __attribute__((packed))
+{
+  uint8_t kind;
+  uint8_t length;
+  uint8_t address;
+  uint8_t packet_type;
+  uint32_t sequence;
+  uint64_t timestamp;						//host monotonic clock, ns
+} log_record;
+
+//sparse index file written next to the log (<log>.idx), one entry per sync 
+//record, so that a reader can binary search by time without scanning the log.
+//A packed log has LOG_BLOCK_INDEX_MAGIC and one entry per block instead, its
+//first timestamp and where it starts in the file.
+typedef struct __attribute__((packed))
+{
+  char magic[8];
+  uint64_t start_host;						//must match the log header
+} log_index_header;
+
+typedef struct __attribute__((packed))
+{
+  uint64_t timestamp;
+  uint64_t offset;							//file offset of the sync record, or of the block
+} log_index_entry;
+
+#define LOG_RECORD_OVERHEAD		(sizeof(log_record) + sizeof(uint16_t))
+
+//a packed log is the same header with LOG_PACKED_MAGIC, then blocks that 
+//each hold whole records and decode on their own. In a block every record 
+//keeps its kind, length, address and packet type, the sequence and time 
+//become varint deltas from the record before, the per-record checksum is 
+//dropped for one over the block, and a packet payload is XORed with the 
+//last payload of the same register. The result is LZ compressed, or stored
+//as is when that does not make it smaller.
+typedef struct __attribute__((packed))
+{
+  char magic[4];
+  uint32_t packed_size;						//bytes that follow, equal to plain_size when stored
+  uint32_t plain_size;						//packed record bytes
+  uint32_t log_size;						//bytes of log records it decodes to
+  uint32_t records;
+  uint32_t checksum;						//of the packed record bytes
+  uint64_t first_timestamp;
+} log_block_header;
+
+//delta state of one block, reset at every block so blocks stay independent
+typedef struct
+{
+  uint32_t sequence;
+  uint64_t timestamp;
+  uint8_t length[256];
+  uint8_t data[256][MAX_PACKET_DATA];		//last payload of each register
+} log_history;
+
+typedef struct
+{
+  log_block_header header;
+  log_history history;
+  uint8_t plain[LOG_BLOCK_SIZE];
+  uint8_t packed[LZ_BOUND(LOG_BLOCK_SIZE)];
+  uint16_t hash[LZ_HASH_SIZE];
+} log_block;
+
+//how a log reaches the disk. With either rotation limit set the capture is
+//split into parts that are each a complete log, imu.log becomes imu.000.log,
+//imu.001.log and so on.
+typedef struct
+{
+  int is_packed;
+  int is_direct;							//O_DIRECT, bypassing the page cache
+  uint64_t sync_interval;					//ns between syncs, bounds the data a power cut loses
+  uint64_t rotate_size;						//plain log bytes per part, 0 for no limit
+  uint64_t rotate_time;						//ns per part, 0 for no limit
+  latency_histogram* write_times;			//optional, ns per block write
+  latency_histogram* sync_times;			//optional, ns per sync
+} log_options;
+
+typedef struct 
+{
+  block_file file;
+  FILE* index;
+  uint32_t records_since_sync;
+  uint64_t bytes_written;					//of the plain log, packed or not
+  log_block* block;							//NULL for a plain log
+  uint64_t packed_bytes;
+  uint32_t write_errors;
+  
+  log_options options;
+  log_header header;						//of the capture, every part starts with a copy
+  char path[256];
+  uint32_t part;
+  uint64_t opened;							//hostTime() the current part was opened
+} log_writer;
+
+void initLogHeader(log_header* header);
+void initLogOptions(log_options* options);
+int openLog(log_writer* log, const char* path, const log_header* header);
+int openPackedLog(log_writer* log, const char* path, const log_header* header);
+int openLogWith(log_writer* log, const char* path, const log_header* header, const log_options* options);
+void tickLog(log_writer* log, uint64_t now);
+void writeLogPacket(log_writer* log, const packet* rx_packet);
+void writeLogSync(log_writer* log, uint32_t sequence, uint64_t timestamp);
+void writeLogEvent(log_writer* log, const packet* rx_packet, uint32_t changed);
+void closeLog(log_writer* log);
+
+uint16_t logChecksum(const log_record* record, const uint8_t* payload);
+uint32_t blockChecksum(const uint8_t* data, uint32_t length);
+void initLogHistory(log_history* history);
+
+#endif
@@ -0,0 +1,673 @@
+#define _GNU_SOURCE
+
+#include "logread.h"
+
+//a packed log is indexed by block, a plain one by sync record
+static const char* indexMagic(const log_reader* reader)
+{
+	return (reader->block) ? LOG_BLOCK_INDEX_MAGIC : LOG_INDEX_MAGIC;
+}
+
+
+static int loadLogIndex(log_reader* reader, const char* index_path)
+{
+	int fd = open(index_path, O_RDONLY);
+	struct stat index_stat;
+	
+	if (fd < 0 || fstat(fd, &index_stat) || index_stat.st_size < sizeof(log_index_header))
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return 0;
+	}
+	
+	log_index_header index_header;
+	uint32_t entries = (index_stat.st_size - sizeof(log_index_header))/sizeof(log_index_entry);
+	
+	if (read(fd, &index_header, sizeof(log_index_header)) != sizeof(log_index_header) ||
+		memcmp(index_header.magic, indexMagic(reader), sizeof(index_header.magic)) ||
+		index_header.start_host != reader->header->start_host)
+	{
+		//index belongs to a different capture
+		close(fd);
+		return 0;
+	}
+	
+	reader->index = malloc(sizeof(log_index_entry)*(entries + 1));
+	
+	if (!reader->index || read(fd, reader->index, sizeof(log_index_entry)*entries) != sizeof(log_index_entry)*entries)
+	{
+		free(reader->index);
+		reader->index = NULL;
+		close(fd);
+		return 0;
+	}
+	
+	close(fd);
+	
+	//a capture that was cut short may have index entries past the end of the log
+	uint64_t least = (reader->block) ? sizeof(log_block_header) : sizeof(log_record);
+	
+	while (entries > 0 && reader->index[entries - 1].offset + least > reader->size)
+	{
+		entries--;
+	}
+	
+	reader->index_entries = entries;
+	
+	return 1;
+}
+
+
+static const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint64_t* value)
+{
+	*value = 0;
+	
+	for (int shift = 0; p < end && shift < 64; shift += 7)
+	{
+		uint8_t byte = *p++;
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		
+		if (!(byte & 0x80))
+		{
+			return p;
+		}
+	}
+	
+	return NULL;
+}
+
+
+//turns the packed records of one block back into log records, false if the
+//block does not add up to what its header says
+static int expandBlock(const uint8_t* plain, uint32_t plain_size, const log_block_header* header, uint8_t* out, log_history* history)
+{
+	const uint8_t* p = plain;
+	const uint8_t* end = plain + plain_size;
+	uint8_t* op = out;
+	uint8_t* out_end = out + header->log_size;
+	
+	initLogHistory(history);
+	
+	for (uint32_t i = 0; i < header->records; i++)
+	{
+		log_record record;
+		uint64_t sequence_delta, time_delta;
+		
+		if (end - p < 4)
+		{
+			return 0;
+		}
+		
+		record.kind = p[0];
+		record.length = p[1];
+		record.address = p[2];
+		record.packet_type = p[3];
+		p += 4;
+		
+		if (!(p = getVarint(p, end, &sequence_delta)) || !(p = getVarint(p, end, &time_delta)))
+		{
+			return 0;
+		}
+		
+		if (end - p < record.length || out_end - op < LOG_RECORD_OVERHEAD + record.length)
+		{
+			return 0;
+		}
+		
+		record.sequence = history->sequence + (uint32_t)sequence_delta;
+		record.timestamp = history->timestamp + (uint64_t)((int64_t)(time_delta >> 1) ^ -(int64_t)(time_delta & 1));
+		history->sequence = record.sequence;
+		history->timestamp = record.timestamp;
+		
+		uint8_t* payload = op + sizeof(log_record);
+		
+		if (record.kind == LOG_PACKET && record.length <= MAX_PACKET_DATA)
+		{
+			uint8_t* previous = history->data[record.address];
+			int is_delta = (history->length[record.address] == record.length);
+			
+			for (int k = 0; k < record.length; k++)
+			{
+				payload[k] = is_delta ? p[k] ^ previous[k] : p[k];
+			}
+			
+			memcpy(previous, payload, record.length);
+			history->length[record.address] = record.length;
+		}
+		else
+		{
+			memcpy(payload, p, record.length);
+		}
+		
+		p += record.length;
+		
+		uint16_t checksum = logChecksum(&record, payload);
+		
+		memcpy(op, &record, sizeof(log_record));
+		memcpy(payload + record.length, &checksum, sizeof(uint16_t));
+		op += LOG_RECORD_OVERHEAD + record.length;
+	}
+	
+	return p == end && op == out_end;
+}
+
+
+static int isZero(const uint8_t* data, uint64_t length)
+{
+	for (uint64_t i = 0; i < length; i++)
+	{
+		if (data[i])
+		{
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+
+//decodes the block at 'offset' into 'view' unless it is there already,
+//false if the block is damaged
+static int loadBlock(const uint8_t* file, uint64_t size, uint64_t offset, log_block_view* view)
+{
+	if (view->offset == offset)
+	{
+		return 1;
+	}
+	
+	view->offset = 0;
+	
+	if (offset + sizeof(log_block_header) > size)
+	{
+		return 0;
+	}
+	
+	const log_block_header* block = (const log_block_header*)&file[offset];
+	const uint8_t* body = &file[offset + sizeof(log_block_header)];
+	int32_t plain_size;
+	
+	if (memcmp(block->magic, LOG_BLOCK_MAGIC, sizeof(block->magic)) || block->plain_size > LOG_BLOCK_SIZE || block->log_size > LOG_BLOCK_LOG_MAX ||
+		block->packed_size > size - offset - sizeof(log_block_header))
+	{
+		return 0;
+	}
+	
+	if (block->packed_size == block->plain_size)
+	{
+		memcpy(view->plain, body, block->plain_size);
+		plain_size = block->plain_size;
+	}
+	else
+	{
+		plain_size = lzDecompress(body, block->packed_size, view->plain, LOG_BLOCK_SIZE);
+	}
+	
+	if (plain_size < 0 || plain_size != block->plain_size || blockChecksum(view->plain, plain_size) != block->checksum ||
+		!expandBlock(view->plain, plain_size, block, view->records, &view->history))
+	{
+		return 0;
+	}
+	
+	view->offset = offset;
+	view->next = offset + sizeof(log_block_header) + block->packed_size;
+	view->size = block->log_size;
+	
+	return 1;
+}
+
+
+//where reading goes on after the damaged block at 'offset', the next block
+//magic or the end of the file. Zeros to the end are the padding of a block 
+//file that was synced but never closed, not damage.
+static uint64_t skipBlock(const uint8_t* file, uint64_t size, uint64_t offset, uint32_t* corrupt_blocks)
+{
+	if (isZero(&file[offset], size - offset))
+	{
+		return size;
+	}
+	
+	(*corrupt_blocks)++;
+	
+	const uint8_t* next = memmem(&file[offset + 1], size - offset - 1, LOG_BLOCK_MAGIC, strlen(LOG_BLOCK_MAGIC));
+	
+	return (next) ? next - file : size;
+}
+
+
+//expands a packed log into a plain one in memory, returns its size or 0 if
+//'file' is not a packed log or there is not the memory for it. A damaged block is skipped by searching for the
+//next block magic, the records in it are lost.
+uint64_t unpackLog(const uint8_t* file, uint64_t size, uint8_t** out, uint32_t* corrupt_blocks)
+{
+	const log_header* header = (const log_header*)file;
+	
+	if (size < sizeof(log_header) || memcmp(header->magic, LOG_PACKED_MAGIC, sizeof(header->magic)))
+	{
+		return 0;
+	}
+	
+	uint64_t capacity = 4*size;
+	uint64_t used = sizeof(log_header);
+	uint64_t offset = sizeof(log_header);
+	uint8_t* data = malloc(capacity);
+	log_block_view* view = malloc(sizeof(log_block_view));
+	
+	if (!data || !view)
+	{
+		free(data);
+		free(view);
+		return 0;
+	}
+	
+	view->offset = 0;
+	memcpy(data, file, sizeof(log_header));
+	memcpy(((log_header*)data)->magic, LOG_MAGIC, sizeof(header->magic));
+	
+	while (offset + sizeof(log_block_header) <= size)
+	{
+		if (!loadBlock(file, size, offset, view))
+		{
+			offset = skipBlock(file, size, offset, corrupt_blocks);
+			continue;
+		}
+		
+		if (used + view->size > capacity)
+		{
+			uint8_t* grown = realloc(data, 2*(used + view->size));
+			
+			if (!grown)
+			{
+				free(data);
+				free(view);
+				return 0;
+			}
+			
+			data = grown;
+			capacity = 2*(used + view->size);
+		}
+		
+		memcpy(&data[used], view->records, view->size);
+		used += view->size;
+		offset = view->next;
+	}
+	
+	free(view);
+	*out = data;
+	
+	return used;
+}
+
+
+int openLogReader(log_reader* reader, const char* path)
+{
+	struct stat log_stat;
+	
+	memset(reader, 0, sizeof(log_reader));
+	
+	if ((reader->fd = open(path, O_RDONLY)) < 0 || fstat(reader->fd, &log_stat))
+	{
+		return 0;
+	}
+	
+	reader->size = log_stat.st_size;
+	
+	if (reader->size < sizeof(log_header))
+	{
+		close(reader->fd);
+		return 0;
+	}
+	
+	reader->data = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, reader->fd, 0);
+	
+	if (reader->data == MAP_FAILED)
+	{
+		close(reader->fd);
+		return 0;
+	}
+	
+	reader->header = (const log_header*)reader->data;
+	
+	if ((memcmp(reader->header->magic, LOG_MAGIC, sizeof(reader->header->magic)) && memcmp(reader->header->magic, LOG_PACKED_MAGIC, sizeof(reader->header->magic))) || 
+		reader->header->version != LOG_VERSION)
+	{
+		closeLogReader(reader);
+		return 0;
+	}
+	
+	//a packed log stays mapped as it is, the block a read lands in is decoded
+	if (!memcmp(reader->header->magic, LOG_PACKED_MAGIC, sizeof(reader->header->magic)))
+	{
+		if (!(reader->block = malloc(sizeof(log_block_view))))
+		{
+			closeLogReader(reader);
+			return 0;
+		}
+		
+		reader->block->offset = 0;
+	}
+	
+	char index_path[256];
+	snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	
+	//fall back to rebuilding the index once if it is missing or stale. 
+	//Without the memory for one the capture still opens, seeks scan.
+	if (!loadLogIndex(reader, index_path))
+	{
+		buildLogIndex(reader, index_path);
+	}
+	
+	return 1;
+}
+
+
+void closeLogReader(log_reader* reader)
+{
+	if (reader->data && reader->data != MAP_FAILED)
+	{
+		munmap((void*)reader->data, reader->size);
+	}
+	
+	if (reader->fd >= 0)
+	{
+		close(reader->fd);
+	}
+	
+	free(reader->block);
+	free(reader->index);
+	memset(reader, 0, sizeof(log_reader));
+	reader->fd = -1;
+}
+
+
+//record at 'offset' lies inside the file, is of a known kind and its
+//checksum matches. Zeros would add up, the kind rules them out.
+static int isValidRecord(log_reader* reader, uint64_t offset)
+{
+	if (offset + LOG_RECORD_OVERHEAD > reader->size)
+	{
+		return 0;
+	}
+	
+	const log_record* record = (const log_record*)&reader->data[offset];
+	
+	if (record->kind != LOG_PACKET && record->kind != LOG_SYNC && record->kind != LOG_EVENT)
+	{
+		return 0;
+	}
+	
+	if (offset + LOG_RECORD_OVERHEAD + record->length > reader->size)
+	{
+		return 0;
+	}
+	
+	uint16_t checksum;
+	memcpy(&checksum, &reader->data[offset + sizeof(log_record) + record->length], sizeof(uint16_t));
+	
+	return checksum == logChecksum(record, &reader->data[offset + sizeof(log_record)]);
+}
+
+
+//offset of the first sync record after 'offset', or the end of the file
+static uint64_t findLogSync(log_reader* reader, uint64_t offset)
+{
+	uint64_t search = offset + sizeof(log_record);
+	
+	while (search < reader->size)
+	{
+		const uint8_t* magic = memmem(&reader->data[search], reader->size - search, LOG_SYNC_MAGIC, 8);
+		
+		if (!magic)
+		{
+			break;
+		}
+		
+		uint64_t candidate = (magic - reader->data) - sizeof(log_record);
+		
+		if (isValidRecord(reader, candidate))
+		{
+			return candidate;
+		}
+		
+		search = (magic - reader->data) + 1;
+	}
+	
+	return reader->size;
+}
+
+
+//the first record of the capture
+static void startCursor(const log_reader* reader, log_cursor* cursor)
+{
+	cursor->offset = (reader->block) ? 0 : sizeof(log_header);
+	cursor->block = (reader->block) ? sizeof(log_header) : 0;
+	cursor->record = NULL;
+	cursor->payload = NULL;
+}
+
+
+//the records of a packed log block by block, a damaged block is skipped whole
+static int nextPackedRecord(log_reader* reader, log_cursor* cursor)
+{
+	log_block_view* view = reader->block;
+	
+	while (cursor->block + sizeof(log_block_header) <= reader->size)
+	{
+		if (!loadBlock(reader->data, reader->size, cursor->block, view))
+		{
+			cursor->block = skipBlock(reader->data, reader->size, cursor->block, &reader->corrupt_regions);
+			cursor->offset = 0;
+			continue;
+		}
+		
+		if (cursor->offset + LOG_RECORD_OVERHEAD > view->size)
+		{
+			cursor->block = view->next;
+			cursor->offset = 0;
+			continue;
+		}
+		
+		cursor->record = (const log_record*)&view->records[cursor->offset];
+		cursor->payload = &view->records[cursor->offset + sizeof(log_record)];
+		cursor->offset += LOG_RECORD_OVERHEAD + cursor->record->length;
+		
+		return 1;
+	}
+	
+	cursor->record = NULL;
+	cursor->payload = NULL;
+	
+	return 0;
+}
+
+
+//advances the cursor to the next valid record, skipping corrupted regions up
+//to the following sync marker. Returns 0 at the end of the capture.
+int nextLogRecord(log_reader* reader, log_cursor* cursor)
+{
+	if (reader->block)
+	{
+		return nextPackedRecord(reader, cursor);
+	}
+	
+	while (cursor->offset + LOG_RECORD_OVERHEAD <= reader->size)
+	{
+		if (!isValidRecord(reader, cursor->offset))
+		{
+			//zeros to the end are the padding of a block file that was synced
+			//but never closed, the capture ends here
+			if (isZero(&reader->data[cursor->offset], reader->size - cursor->offset))
+			{
+				cursor->offset = reader->size;
+				break;
+			}
+			
+			reader->corrupt_regions++;
+			cursor->offset = findLogSync(reader, cursor->offset);
+			continue;
+		}
+		
+		cursor->record = (const log_record*)&reader->data[cursor->offset];
+		cursor->payload = &reader->data[cursor->offset + sizeof(log_record)];
+		cursor->offset += LOG_RECORD_OVERHEAD + cursor->record->length;
+		
+		return 1;
+	}
+	
+	cursor->record = NULL;
+	cursor->payload = NULL;
+	
+	return 0;
+}
+
+
+static int addIndexEntry(log_reader* reader, uint32_t* capacity, uint64_t timestamp, uint64_t offset)
+{
+	if (reader->index_entries == *capacity)
+	{
+		log_index_entry* grown = realloc(reader->index, sizeof(log_index_entry)*2*(*capacity));
+		
+		if (!grown)
+		{
+			return 0;
+		}
+		
+		reader->index = grown;
+		*capacity *= 2;
+	}
+	
+	log_index_entry entry = {timestamp, offset};
+	reader->index[reader->index_entries++] = entry;
+	
+	return 1;
+}
+
+
+//without the memory for an index the reader still works, seeks scan from
+//the start
+static int dropLogIndex(log_reader* reader)
+{
+	free(reader->index);
+	reader->index = NULL;
+	reader->index_entries = 0;
+	
+	return 0;
+}
+
+
+//hops from record to record through the length fields to recover the sync
+//offsets, or from block to block in a packed log, then saves them so the
+//next open does not have to
+int buildLogIndex(log_reader* reader, const char* index_path)
+{
+	uint32_t capacity = 1024;
+	
+	free(reader->index);
+	reader->index = malloc(sizeof(log_index_entry)*capacity);
+	reader->index_entries = 0;
+	
+	if (!reader->index)
+	{
+		return dropLogIndex(reader);
+	}
+	
+	if (reader->block)
+	{
+		uint64_t offset = sizeof(log_header);
+		
+		while (offset + sizeof(log_block_header) <= reader->size)
+		{
+			if (!loadBlock(reader->data, reader->size, offset, reader->block))
+			{
+				offset = skipBlock(reader->data, reader->size, offset, &reader->corrupt_regions);
+				continue;
+			}
+			
+			if (!addIndexEntry(reader, &capacity, ((const log_block_header*)&reader->data[offset])->first_timestamp, offset))
+			{
+				return dropLogIndex(reader);
+			}
+			
+			offset = reader->block->next;
+		}
+	}
+	else
+	{
+		log_cursor cursor;
+		
+		startCursor(reader, &cursor);
+		
+		while (nextLogRecord(reader, &cursor))
+		{
+			if (cursor.record->kind == LOG_SYNC && !addIndexEntry(reader, &capacity, cursor.record->timestamp, (const uint8_t*)cursor.record - reader->data))
+			{
+				return dropLogIndex(reader);
+			}
+		}
+	}
+	
+	FILE* index_file = fopen(index_path, "wb");
+	
+	if (!index_file)
+	{
+		return 0;
+	}
+	
+	log_index_header index_header;
+	memcpy(index_header.magic, indexMagic(reader), sizeof(index_header.magic));
+	index_header.start_host = reader->header->start_host;
+	
+	fwrite(&index_header, sizeof(log_index_header), 1, index_file);
+	fwrite(reader->index, sizeof(log_index_entry), reader->index_entries, index_file);
+	fclose(index_file);
+	
+	return 1;
+}
+
+
+//positions the cursor on the first record stamped at or after 'timestamp',
+//using a binary search over the sparse index and a short forward walk
+void seekLog(log_reader* reader, uint64_t timestamp, log_cursor* cursor)
+{
+	uint32_t low = 0;
+	uint32_t high = reader->index_entries;
+	
+	//find the last index entry at or before the requested time
+	while (low < high)
+	{
+		uint32_t mid = low + (high - low)/2;
+		
+		if (reader->index[mid].timestamp <= timestamp)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	
+	startCursor(reader, cursor);
+	
+	if (low > 0 && reader->block)
+	{
+		cursor->block = reader->index[low - 1].offset;
+	}
+	else if (low > 0)
+	{
+		cursor->offset = reader->index[low - 1].offset;
+	}
+	
+	//walk forward to the first matching record without consuming it
+	log_cursor probe = *cursor;
+	
+	while (nextLogRecord(reader, &probe) && probe.record->timestamp < timestamp)
+	{
+		*cursor = probe;
+	}
+	
+	cursor->record = NULL;
+	cursor->payload = NULL;
+}
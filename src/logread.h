@@ -0,0 +1,60 @@
+#ifndef LOGREAD_H
+#define LOGREAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+
+#define LOG_BLOCK_LOG_MAX		(3*LOG_BLOCK_SIZE)	//log bytes a block can decode to, a packed record is at least a third of its log record
+
+//one block of a packed log decoded back into log records
+typedef struct 
+{
+  uint64_t offset;				//file offset of the block, 0 for none
+  uint64_t next;				//file offset of the block after it
+  uint32_t size;				//bytes of log records in 'records'
+  log_history history;
+  uint8_t plain[LOG_BLOCK_SIZE];
+  uint8_t records[LOG_BLOCK_LOG_MAX];
+} log_block_view;
+
+//read-only view of a capture mapped into memory. A packed log stays packed,
+//the blocks a read reaches are decoded one at a time.
+typedef struct 
+{
+  int fd;
+  const uint8_t* data;
+  uint64_t size;
+  log_block_view* block;			//of a packed log, NULL for a plain one
+  const log_header* header;
+  log_index_entry* index;
+  uint32_t index_entries;
+  uint32_t corrupt_regions;
+} log_reader;
+
+//position in a capture. 'record' and 'payload' point into the mapping, or in 
+//a packed log into the decoded block, until the next read.
+typedef struct 
+{
+  uint64_t offset;				//offset of the next record to read, into the block in a packed log
+  uint64_t block;				//file offset of the block being read, 0 in a plain log
+  const log_record* record;
+  const uint8_t* payload;
+} log_cursor;
+
+int openLogReader(log_reader* reader, const char* path);
+uint64_t unpackLog(const uint8_t* file, uint64_t size, uint8_t** out, uint32_t* corrupt_blocks);
+void closeLogReader(log_reader* reader);
+int buildLogIndex(log_reader* reader, const char* index_path);
+
+void seekLog(log_reader* reader, uint64_t timestamp, log_cursor* cursor);
+int nextLogRecord(log_reader* reader, log_cursor* cursor);
+
+#endif
@@ -2,60 +2,221 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <termios.h>
+#include <signal.h>
 #include <libserialport.h>
 
 #include "colour.h"
 #include "imu.h"
 #include "binary.h"
+#include "queue.h"
+#include "log.h"
+#include "clock.h"
+#include "realtime.h"
+#include "align.h"
+#include "snapshot.h"
+#include "reactor.h"
+#include "metrics.h"
+#include "shmring.h"
 
 void splash(void);
 void help(void);
 void imu_worker(void);
+void log_worker(void);
+void read_log_header(imu_device* dev, log_header* header);
+void device_path(char* path, size_t size, const char* name, int index);
 void parse_options(int argc, char *argv[]);
+void stop(int signal);
 
-extern heartbeat beat;
-extern uint8_t* byte_buffer;
+imu_device imu_devices[REACTOR_MAX_DEVICES];
+log_header imu_log_headers[REACTOR_MAX_DEVICES];
+reactor imu_reactor;
+metrics_page* imu_metrics;
+sample_ring* imu_ring;
 
 //global flags
 int is_experiment_active = 0;
 int is_debug_mode = 0;
 int is_reset = 0;
+int uart_low_water = UART_LOW_WATER;
+int uart_timeout_ms = UART_TIMEOUT_MS;
+char* uart_ports[REACTOR_MAX_DEVICES] = {UART_PORT};
+int n_devices = 0;
+int uart_baud_rate_option = 0;
+int is_profile_set = 0;
+rate_profile imu_profile;
+char* config_save_path = NULL;
+char* config_restore_path = NULL;
+int realtime_priority = 0;
+int realtime_cpu = -1;
+int is_memory_locked = 0;
+mode_t ring_mode = SHMRING_MODE;
+log_options imu_log_options;
+volatile int is_running = 1;
+realtime_cycle imu_cycle;
 
 int main(int argc, char *argv[])
 {
+	initProfile(&imu_profile);
+	initLogOptions(&imu_log_options);
 	parse_options(argc, argv);
 	splash();
 	
-	initUART();
-	initIMU(is_debug_mode, is_reset);
+	if (is_profile_set || is_debug_mode)
+	{
+		if (!checkProfile(&imu_profile))
+		{
+			exit(EXIT_FAILURE);
+		}
+		
+		printProfile(&imu_profile);
+	}
 	
-	if (is_debug_mode)
+	if (n_devices == 0)
 	{
-		printConfiguration();
+		n_devices = 1;
 	}
 	
-	getHeartbeat();
-	printHeartbeat();
+	//counters are kept from the first register request, um7rp-stat can 
+	//watch them from another process
+	imu_metrics = createMetrics(n_devices);
+	
+	//every decoded packet is published for processes that follow the run live
+	imu_ring = createRing(ring_mode);
+	
+	if (!initReactor(&imu_reactor))
+	{
+		exit(EXIT_FAILURE);
+	}
+	
+	//every device is set up in turn, the profile and configuration apply to all
+	for (int i = 0; i < n_devices; i++)
+	{
+		imu_device* dev = &imu_devices[i];
+		char path[256];
+		
+		initDevice(dev, i, &imu_metrics->devices[i]);
+		dev->ring = imu_ring;
+		
+		//open the port at the rate the IMU is expected to be on, the profile 
+		//switches both ends if it asks for something else
+		initUART(dev, uart_ports[i], uart_baud_rate_option ? uart_baud_rate_option : UART_BAUD_RATE);
+		
+		if (config_restore_path)
+		{
+			device_path(path, sizeof(path), config_restore_path, i);
+			
+			if (!restoreConfiguration(dev, path))
+			{
+				exit(EXIT_FAILURE);
+			}
+		}
+		
+		initIMU(dev, is_debug_mode, is_reset, (is_profile_set || is_debug_mode) ? &imu_profile : NULL);
+		
+		if (config_save_path)
+		{
+			device_path(path, sizeof(path), config_save_path, i);
+			dumpConfiguration(dev, path);
+		}
+		
+		if (is_debug_mode)
+		{
+			printConfiguration(dev);
+		}
+		
+		if (getHeartbeat(dev))
+		{
+			printHeartbeat(&dev->beat);
+		}
+		
+		//the device is quiet to configuration requests once the capture starts
+		read_log_header(dev, &imu_log_headers[i]);
+		
+		if (!addDevice(&imu_reactor, dev))
+		{
+			exit(EXIT_FAILURE);
+		}
+	}
 
 	pthread_t imu_thread;
-
-	if (pthread_create(&imu_thread, NULL, (void*)imu_worker, NULL))
+	pthread_t log_thread;
+	
+	initCycle(&imu_cycle, REALTIME_PERIOD_NS);
+	
+	if (is_memory_locked && !lockMemory())
 	{
-		cprint("[!!] ", BRIGHT, RED);
-		printf("Error launching imu thread.\n");
+		exit(EXIT_FAILURE);
 	}
-	else
+	
+	//start experiment
+	is_experiment_active = 1;
+
+	if (pthread_create(&imu_thread, NULL, (void*)imu_worker, NULL) || pthread_create(&log_thread, NULL, (void*)log_worker, NULL))
 	{
-		//start experiment
-		is_experiment_active = 1;
-		cprint("[OK] ", BRIGHT, GREEN);
-		printf("Experiment active.\n");
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Error launching imu threads.\n");
+		exit(EXIT_FAILURE);
 	}
+	
+	//stop on Ctrl+C or a kill so the logs are drained, synced and closed
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Experiment active, Ctrl+C to stop.\n");
 
-	while (1)
+	uint32_t health_flags[REACTOR_MAX_DEVICES] = {0};
+	
+	while (is_running)
 	{
-		//sleep for a while to emulate other work
+		//sleep for a while to emulate other work, which takes the latest 
+		//attitude with readSnapshot whenever it needs one
 		sleep(1);
+		
+		if (is_debug_mode)
+		{
+			for (int i = 0; i < n_devices; i++)
+			{
+				imu_device* dev = &imu_devices[i];
+				device_metrics* m = dev->metrics;
+				imu_snapshot latest;
+				
+				cprint("[**] ", BRIGHT, CYAN);
+				printf("IMU %i: %llu packets, %llu bytes in %llu reads, %llu checksum errors. Queue: %llu/%u packets, high water %llu, dropped %llu.\n", i,
+					(unsigned long long)readCounter(&m->packets), (unsigned long long)readCounter(&m->bytes), (unsigned long long)readCounter(&m->reads), 
+					(unsigned long long)readCounter(&m->checksum_errors), (unsigned long long)readCounter(&m->queue_depth), QUEUE_SIZE, 
+					(unsigned long long)readCounter(&m->queue_high_water), (unsigned long long)readCounter(&m->queue_dropped));
+				
+				if (readSnapshot(&dev->latest, &latest))
+				{
+					uint32_t flags = healthFlags(&latest.state.health);
+					
+					cprint("[**] ", BRIGHT, CYAN);
+					printf("IMU %i attitude: roll %.2f, pitch %.2f, yaw %.2f deg, %.1f ms old.\n", i, latest.state.euler.roll, latest.state.euler.pitch, latest.state.euler.yaw, (hostTime() - latest.timestamp)*1e-6);
+					
+					//the heartbeat comes with the snapshot, nothing is asked of the IMU
+					if (flags != health_flags[i])
+					{
+						cprint("[**] ", BRIGHT, RED);
+						printf("IMU %i health:", i);
+						printHealthChanges(stdout, flags, flags ^ health_flags[i]);
+						printf("\n");
+						printHeartbeat(&latest.state.health);
+						health_flags[i] = flags;
+					}
+				}
+			}
+		}
+		
+		if (realtime_priority > 0)
+		{
+			latency_histogram* wakeup = &imu_cycle.wakeup;
+			
+			cprint("[**] ", BRIGHT, CYAN);
+			printf("Wakeup latency: p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f us, %llu overruns.\n", 
+				histogramPercentile(wakeup, 50)*1e-3, histogramPercentile(wakeup, 99)*1e-3, histogramPercentile(wakeup, 99.9)*1e-3, 
+				histogramPercentile(wakeup, 100)*1e-3, (unsigned long long)__atomic_load_n(&imu_cycle.overruns, __ATOMIC_RELAXED));
+		}
 	}
 
 	//stop experiment
@@ -63,6 +224,21 @@ int main(int argc, char *argv[])
 
 	//join all threads
 	pthread_join(imu_thread, NULL);
+	pthread_join(log_thread, NULL);
+	closeMetrics(imu_metrics);
+	
+	if (imu_ring)
+	{
+		closeRing(imu_ring);
+	}
+	
+	for (int i = 0; i < n_devices; i++)
+	{
+		dnitUART(&imu_devices[i]);
+	}
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Experiment stopped, logs closed.\n");
 
 	if (is_debug_mode)
 	{
@@ -71,7 +247,7 @@ int main(int argc, char *argv[])
 		
 		//copy experiment folder from red pitaya to host computer
 		char command[100];
-		sprintf(command, "scp imu.bin darryn@10.42.0.1:/home/darryn/Dropbox/Datasets/Temp");		
+		sprintf(command, "scp %s darryn@10.42.0.1:/home/darryn/Dropbox/Datasets/Temp", imu_log_options.is_packed ? "imu*.lz" : "imu*.log");		
 		system(command);
 	}
 
@@ -79,35 +255,167 @@ int main(int argc, char *argv[])
 }
 
 
+//services every IMU from this one thread and hands complete packets to the 
+//log writer, never touches the disk so that file I/O stalls cannot back up 
+//the serial ports
 void imu_worker(void)
 {
-	FILE *f_imu_bin;
-	FILE *f_imu_txt;
-
-	if (!(f_imu_bin = fopen("imu.bin", "wb")))
+	if (realtime_cpu >= 0)
 	{
-		printf("imu file open failed\n");
-		exit(EXIT_FAILURE);
+		setCpuAffinity(realtime_cpu);
 	}
 	
-	if (!(f_imu_txt = fopen("imu.txt", "w")))
+	if (realtime_priority > 0)
 	{
-		printf("imu file open failed\n");
-		exit(EXIT_FAILURE);
+		setRealtimePriority(realtime_priority);
 	}
-
+	
+	if (realtime_priority > 0 || is_memory_locked)
+	{
+		//take every page fault of the loop now rather than on the first samples
+		prefaultStack();
+		prefault(imu_devices, n_devices*sizeof(imu_device));
+	}
+	
 	//while experiment is active
 	while (is_experiment_active)
 	{
-		int bytes_read = getUART();
-		//printf("Read %i bytes\n", bytes_read);
-		fprintf(f_imu_txt, "%s\n", byte_buffer);
-		fwrite(byte_buffer, sizeof(uint8_t), bytes_read, f_imu_bin);
-		usleep(0.1e6);
+		if (realtime_priority > 0)
+		{
+			//read on a fixed period, a sample waits at most one period plus
+			//the wakeup latency
+			waitCycle(&imu_cycle);
+			pollReactor(&imu_reactor);
+		}
+		else
+		{
+			//sleep until data arrives rather than polling the ports
+			runReactor(&imu_reactor, uart_low_water, uart_timeout_ms);
+		}
 	}
+}
 
-	fclose(f_imu_bin);
-	fclose(f_imu_txt);
+
+//drains the packet queues in batches and writes each IMU's packets to its log
+void log_worker(void)
+{
+	log_writer imu_logs[REACTOR_MAX_DEVICES];
+	packet batch[QUEUE_BATCH];
+	
+	for (int i = 0; i < n_devices; i++)
+	{
+		char path[32];
+		log_options options = imu_log_options;
+		
+		device_path(path, sizeof(path), options.is_packed ? "imu.lz" : "imu.log", i);
+		options.write_times = &imu_devices[i].metrics->log_write;
+		options.sync_times = &imu_devices[i].metrics->log_sync;
+		
+		if (!openLogWith(&imu_logs[i], path, &imu_log_headers[i], &options))
+		{
+			printf("imu file open failed\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	//keep draining after the experiment stops until the queues are empty
+	while (1)
+	{
+		int total = 0;
+		
+		for (int i = 0; i < n_devices; i++)
+		{
+			device_metrics* metrics = imu_devices[i].metrics;
+			int n = queuePop(&imu_devices[i].queue, batch, QUEUE_BATCH);
+			
+			for (int k = 0; k < n; k++)
+			{
+				writeLogPacket(&imu_logs[i], &batch[k]);
+				
+				if (batch[k].health_changed)
+				{
+					writeLogEvent(&imu_logs[i], &batch[k], batch[k].health_changed);
+				}
+			}
+			
+			//the whole batch reached the log together
+			uint64_t written = hostTime();
+			
+			for (int k = 0; k < n; k++)
+			{
+				recordHistogram(&metrics->decode_to_disk, written - batch[k].decoded);
+			}
+			
+			addCounter(&metrics->logged_packets, n);
+			
+			//syncs and rotation go by time, also while the IMU is quiet
+			tickLog(&imu_logs[i], written);
+			setCounter(&metrics->log_write_errors, imu_logs[i].write_errors);
+			total += n;
+		}
+		
+		if (total == 0)
+		{
+			if (!is_experiment_active)
+			{
+				break;
+			}
+			
+			usleep(QUEUE_DRAIN_INTERVAL);
+		}
+	}
+
+	for (int i = 0; i < n_devices; i++)
+	{
+		closeLog(&imu_logs[i]);
+	}
+}
+
+
+//a file of one IMU: 'name' itself with a single IMU, otherwise the index 
+//goes before the extension, imu.log -> imu0.log, imu1.log
+void device_path(char* path, size_t size, const char* name, int index)
+{
+	const char* extension = strrchr(name, '.');
+	
+	if (n_devices == 1)
+	{
+		snprintf(path, size, "%s", name);
+	}
+	else if (extension)
+	{
+		snprintf(path, size, "%.*s%i%s", (int)(extension - name), name, index, extension);
+	}
+	else
+	{
+		snprintf(path, size, "%s%i", name, index);
+	}
+}
+
+
+//records the firmware revision and configuration registers for the log header
+void read_log_header(imu_device* dev, log_header* header)
+{
+	initLogHeader(header);
+	
+	transaction_set set;
+	transaction* t;
+	
+	//firmware revision and one batch read of the configuration registers
+	initTransactions(&set);
+	addTransaction(&set, GET_FW_REVISION, 0, NULL);
+	addBatchTransaction(&set, CREG_COM_SETTINGS, LOG_CONFIG_REGISTERS, NULL);
+	runTransactions(dev, &set);
+	
+	if ((t = findTransaction(&set, GET_FW_REVISION)))
+	{
+		memcpy(header->firmware, t->response.data, 4);
+	}
+	
+	if ((t = findTransaction(&set, CREG_COM_SETTINGS)))
+	{
+		memcpy(header->config, t->response.data, 4*LOG_CONFIG_REGISTERS);
+	}
 }
 
 
@@ -135,6 +443,26 @@ void help(void)
 	splash();
 	printf(" -h: display this help screen\n");
 	printf(" -d: enable debug mode\n");
+	printf(" -r: reset the IMU to factory settings\n");
+	printf(" -p: serial port of an IMU (default %s), repeat for up to %i IMUs\n", UART_PORT, REACTOR_MAX_DEVICES);
+	printf(" -B: baud rate the IMU is on at startup (default %i)\n", UART_BAUD_RATE);
+	printf(" -b: baud rate to switch the IMU and host to (up to 921600)\n");
+	printf(" -P: load a broadcast rate profile, 'name = value' per line\n");
+	printf(" -R: set one broadcast rate field, e.g. -R all_proc_rate=100\n");
+	printf(" -w: restore the IMU configuration from a file saved with -s\n");
+	printf(" -s: save the IMU configuration to a file once it is set up\n");
+	printf(" -l: bytes to wait for before waking the reader (default %i)\n", UART_LOW_WATER);
+	printf(" -t: longest the reader sleeps in ms (default %i)\n", UART_TIMEOUT_MS);
+	printf(" -f: run the reader at this SCHED_FIFO priority, reading every %llu us\n", REALTIME_PERIOD_NS/1000);
+	printf(" -c: pin the reader to this CPU\n");
+	printf(" -m: lock all memory and prefault the reader's buffers\n");
+	printf(" -z: write compressed logs (imu.lz), read them with um7rp-log or um7rp-unpack\n");
+	printf(" -S: seconds between log syncs, at most this much is lost on a power cut (default %.0f)\n", LOG_FSYNC_INTERVAL*1e-9);
+	printf(" -D: write the logs with O_DIRECT\n");
+	printf(" -M: start a new log file every this many MB\n");
+	printf(" -T: start a new log file every this many seconds\n");
+	printf(" -A: permissions of the sample ring %s in octal (default %04o), the\n", SHMRING_NAME, SHMRING_MODE);
+	printf("     users of um7rp-tail, -resample -f and -nav -f need write access\n");
 	exit(EXIT_SUCCESS);
 }
 
@@ -144,7 +472,7 @@ void parse_options(int argc, char *argv[])
 	int opt;
 
 	//retrieve command-line options
-    while ((opt = getopt(argc, argv, "dhr")) != -1)
+    while ((opt = getopt(argc, argv, "dhrp:B:b:P:R:s:w:l:t:f:c:mzS:DM:T:A:")) != -1)
     {
         switch (opt)
         {
@@ -157,6 +485,81 @@ void parse_options(int argc, char *argv[])
 			case 'r':
 				is_reset = 1;
 				break;
+			case 'p':
+				if (n_devices == REACTOR_MAX_DEVICES)
+				{
+					fprintf(stderr, "At most %i IMUs.\n", REACTOR_MAX_DEVICES);
+					exit(EXIT_FAILURE);
+				}
+				
+				uart_ports[n_devices++] = optarg;
+				break;
+			case 'B':
+				uart_baud_rate_option = atoi(optarg);
+				break;
+			case 'b':
+				is_profile_set = 1;
+				imu_profile.baud_rate = atoi(optarg);
+				break;
+			case 'P':
+				is_profile_set = 1;
+				
+				if (!loadProfile(&imu_profile, optarg))
+				{
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'R':
+			{
+				is_profile_set = 1;
+				char* value = strchr(optarg, '=');
+				
+				if (!value || (*value++ = '\0', !setProfileField(&imu_profile, optarg, value)))
+				{
+					fprintf(stderr, "Bad rate setting '%s'.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			}
+			case 's':
+				config_save_path = optarg;
+				break;
+			case 'w':
+				config_restore_path = optarg;
+				break;
+			case 'l':
+				uart_low_water = atoi(optarg);
+				break;
+			case 't':
+				uart_timeout_ms = atoi(optarg);
+				break;
+			case 'f':
+				realtime_priority = atoi(optarg);
+				break;
+			case 'c':
+				realtime_cpu = atoi(optarg);
+				break;
+			case 'm':
+				is_memory_locked = 1;
+				break;
+			case 'z':
+				imu_log_options.is_packed = 1;
+				break;
+			case 'S':
+				imu_log_options.sync_interval = atof(optarg)*1e9;
+				break;
+			case 'D':
+				imu_log_options.is_direct = 1;
+				break;
+			case 'M':
+				imu_log_options.rotate_size = atof(optarg)*1048576;
+				break;
+			case 'T':
+				imu_log_options.rotate_time = atof(optarg)*1e9;
+				break;
+			case 'A':
+				ring_mode = strtol(optarg, NULL, 8) & 0777;
+				break;
 			case '?':
 				fprintf (stderr, "Unknown option character `\\x%x'.\n", optopt);
         }
@@ -164,5 +567,12 @@ void parse_options(int argc, char *argv[])
 }
 
 
+//Ctrl+C and kill end the capture cleanly
+void stop(int signal)
+{
+	is_running = 0;
+}
+
+
 
 
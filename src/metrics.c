@@ -0,0 +1,113 @@
+#include "metrics.h"
+
+static void initMetrics(metrics_page* page, int n_devices, int is_shared)
+{
+	memset(page, 0, sizeof(metrics_page));
+	
+	page->version = METRICS_VERSION;
+	page->size = sizeof(metrics_page);
+	page->is_shared = is_shared;
+	page->pid = getpid();
+	page->n_devices = n_devices;
+	page->start_time = hostTime();
+	
+	for (int i = 0; i < METRICS_MAX_DEVICES; i++)
+	{
+		initHistogram(&page->devices[i].arrival_to_decode);
+		initHistogram(&page->devices[i].decode_to_disk);
+		initHistogram(&page->devices[i].log_write);
+		initHistogram(&page->devices[i].log_sync);
+	}
+	
+	//the magic goes in last so a reader never takes a half-made page
+	__atomic_store_n(&page->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+}
+
+
+//the metrics page of this process, in shared memory when possible. Without
+//shared memory the counters are still kept, only um7rp-stat cannot see them.
+metrics_page* createMetrics(int n_devices)
+{
+	int fd = shm_open(METRICS_SHM_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	
+	if (fd >= 0)
+	{
+		if (ftruncate(fd, sizeof(metrics_page)) == 0)
+		{
+			metrics_page* page = mmap(NULL, sizeof(metrics_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			
+			if (page != MAP_FAILED)
+			{
+				close(fd);
+				initMetrics(page, n_devices, 1);
+				
+				return page;
+			}
+		}
+		
+		close(fd);
+		shm_unlink(METRICS_SHM_NAME);
+	}
+	
+	perror("Metrics shared memory");
+	
+	metrics_page* page = malloc(sizeof(metrics_page));
+	
+	if (!page)
+	{
+		exit(EXIT_FAILURE);
+	}
+	
+	initMetrics(page, n_devices, 0);
+	
+	return page;
+}
+
+
+//maps the page of a running um7rp read-only, NULL if there is none
+const metrics_page* openMetrics(void)
+{
+	int fd = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+	struct stat st;
+	
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(metrics_page))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	const metrics_page* page = mmap(NULL, sizeof(metrics_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (page == MAP_FAILED)
+	{
+		return NULL;
+	}
+	
+	if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC || page->version != METRICS_VERSION || page->size != sizeof(metrics_page))
+	{
+		munmap((void*)page, sizeof(metrics_page));
+		return NULL;
+	}
+	
+	return page;
+}
+
+
+void closeMetrics(metrics_page* page)
+{
+	if (page->is_shared)
+	{
+		munmap(page, sizeof(metrics_page));
+		shm_unlink(METRICS_SHM_NAME);
+	}
+	else
+	{
+		free(page);
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "histogram.h"
+#include "clock.h"
+
+#define METRICS_SHM_NAME		"/um7rp-metrics"
+#define METRICS_MAGIC			0x53374d55	//'UM7S'
+#define METRICS_VERSION			2
+#define METRICS_MAX_DEVICES		8
+
+//counters and latencies of one IMU. Every field has a single writer thread,
+//updates are relaxed atomic stores so a reader in another process never sees
+//a torn value, only one that is a little behind.
+typedef struct
+{
+  //acquisition thread
+  uint64_t reads;						//reads that returned data
+  uint64_t bytes;
+  uint64_t packets;
+  uint64_t checksum_errors;				//parser resyncs on a bad checksum
+  uint64_t skipped_bytes;				//bytes searched past looking for 'snp'
+  uint64_t dropped_bytes;				//bytes lost to a full parser ring
+  uint64_t address_mismatches;			//packets read while waiting for another register
+  uint64_t queue_depth;
+  uint64_t queue_high_water;
+  uint64_t queue_dropped;
+  uint64_t health_transitions;			//health packets that raised or cleared a fault
+  latency_histogram arrival_to_decode;	//last byte read to packet decoded, ns
+  
+  //log writer thread
+  uint64_t logged_packets;
+  uint64_t log_write_errors;
+  latency_histogram decode_to_disk;		//packet decoded to record handed to the log file, ns
+  latency_histogram log_write;			//one block write, ns
+  latency_histogram log_sync;			//one sync to the media, ns
+} device_metrics;
+
+//the page a running um7rp shares with um7rp-stat
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;						//sizeof(metrics_page) of the writer
+  uint32_t is_shared;					//0 when shared memory was unavailable
+  int32_t pid;
+  uint32_t n_devices;
+  uint64_t start_time;					//hostTime() when acquisition began
+  device_metrics devices[METRICS_MAX_DEVICES];
+} metrics_page;
+
+metrics_page* createMetrics(int n_devices);
+const metrics_page* openMetrics(void);
+void closeMetrics(metrics_page* page);
+
+static inline void addCounter(uint64_t* counter, uint64_t n)
+{
+	__atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline void setCounter(uint64_t* counter, uint64_t value)
+{
+	__atomic_store_n(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t readCounter(const uint64_t* counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include "parser.h"
+#include "scan.h"
+
+#define RING(p, i) ((p)->ring[(i) & PARSER_RING_MASK])
+
+void initParser(parser* p)
+{
+	memset(p, 0, sizeof(parser));
+}
+
+
+uint32_t parserPending(const parser* p)
+{
+	return p->head - p->tail;
+}
+
+
+// Append received bytes to the ring. If the ring cannot hold them the oldest
+// unparsed bytes are discarded, so the parser always resumes on fresh data.
+uint32_t parserPush(parser* p, const uint8_t* data, uint32_t length)
+{
+	if (length > PARSER_RING_SIZE)
+	{
+		p->dropped_bytes += length - PARSER_RING_SIZE;
+		data += length - PARSER_RING_SIZE;
+		length = PARSER_RING_SIZE;
+	}
+	
+	uint32_t space = PARSER_RING_SIZE - parserPending(p);
+	
+	if (length > space)
+	{
+		p->dropped_bytes += length - space;
+		p->tail += length - space;
+	}
+	
+	// Copy in at most two pieces, either side of the wrap point
+	uint32_t offset = p->head & PARSER_RING_MASK;
+	uint32_t first = PARSER_RING_SIZE - offset;
+	
+	if (first > length)
+	{
+		first = length;
+	}
+	
+	memcpy(&p->ring[offset], data, first);
+	memcpy(&p->ring[0], data + first, length - first);
+	p->head += length;
+	
+	return length;
+}
+
+
+// Emit the next complete packet with a good checksum. Returns 0 once the ring
+// holds no further complete packet; a partial packet stays at the tail and the
+// search resumes there on the next call, so every byte is examined a bounded
+// number of times regardless of how the stream was split across reads.
+int parserNext(parser* p, packet* rx_packet)
+{
+	while (parserPending(p) >= 3)
+	{
+		if (RING(p, p->tail) != 's' || RING(p, p->tail + 1) != 'n' || RING(p, p->tail + 2) != 'p')
+		{
+			//lost sync, skip to the next header candidate in the unwrapped part
+			//of the ring at once. Near the wrap the last bytes go one by one.
+			uint32_t offset = p->tail & PARSER_RING_MASK;
+			uint32_t span = PARSER_RING_SIZE - offset;
+			uint32_t skip = findHeader(&p->ring[offset], (span < parserPending(p)) ? span : parserPending(p));
+			
+			skip = (skip) ? skip : 1;
+			p->tail += skip;
+			p->skipped_bytes += skip;
+			continue;
+		}
+		
+		// Found the 'snp' header, wait for the packet type byte to learn the length
+		if (parserPending(p) < MIN_PACKET_LENGTH)
+		{
+			return 0;
+		}
+		
+		uint8_t PT = RING(p, p->tail + 3);
+		uint8_t data_length = 0;
+		
+		if (PT & PT_HAS_DATA)
+		{
+			data_length = (PT & PT_IS_BATCH) ? 4*((PT >> 2) & 0x0F) : 4;
+		}
+		
+		if (parserPending(p) < (uint32_t)(data_length + MIN_PACKET_LENGTH))
+		{
+			//packet is split across reads, keep it for the next push
+			return 0;
+		}
+		
+		uint8_t address = RING(p, p->tail + 4);
+		uint32_t start = (p->tail + 5) & PARSER_RING_MASK;
+		uint32_t first = PARSER_RING_SIZE - start;
+		
+		//the payload may wrap, copy it out in at most two pieces
+		if (first >= data_length)
+		{
+			memcpy(rx_packet->data, &p->ring[start], data_length);
+		}
+		else
+		{
+			memcpy(rx_packet->data, &p->ring[start], first);
+			memcpy(&rx_packet->data[first], p->ring, data_length - first);
+		}
+		
+		uint16_t computed_checksum = 's' + 'n' + 'p' + PT + address + sumBytes(rx_packet->data, data_length);
+		
+		uint16_t received_checksum = RING(p, p->tail + 5 + data_length) << 8;
+		received_checksum |= RING(p, p->tail + 6 + data_length);
+		
+		if (received_checksum != computed_checksum)
+		{
+			//bad checksum, resynchronise on the byte after the 's'
+			p->checksum_errors++;
+			p->tail++;
+			p->skipped_bytes++;
+			continue;
+		}
+		
+		rx_packet->is_valid = 1;
+		rx_packet->address = address;
+		rx_packet->packet_type = PT;
+		rx_packet->n_data_bytes = data_length;
+		rx_packet->checksum = computed_checksum;
+		rx_packet->sequence = p->packets;
+		
+		p->tail += data_length + MIN_PACKET_LENGTH;
+		p->packets++;
+		
+		return 1;
+	}
+	
+	return 0;
+}
+
+
+// Serialise a packet to its wire format, 'buffer' must hold MAX_PACKET_LENGTH
+// bytes. Returns the number of bytes written.
+uint8_t encodePacket(const packet* tx_packet, uint8_t* buffer)
+{
+	buffer[0] = 's';
+	buffer[1] = 'n';
+	buffer[2] = 'p';
+	buffer[3] = tx_packet->packet_type;
+	buffer[4] = tx_packet->address;
+	
+	//Calculate checksum and add data to buffer
+	uint16_t checksum = 's' + 'n' + 'p' + buffer[3] + buffer[4];
+	
+	int i;
+	
+	for (i = 0; i < tx_packet->n_data_bytes; i++)
+	{
+		buffer[5 + i] = tx_packet->data[i];
+		checksum += tx_packet->data[i];
+	}
+	
+	buffer[5 + i] = checksum >> 8;
+	buffer[6 + i] = checksum & 0xff;
+	
+	return tx_packet->n_data_bytes + MIN_PACKET_LENGTH;
+}
+
+
+// Parse the serial data obtained through the UART interface and fit to a general packet structure.
+// This is the original single-read parser: it finds the first packet matching 'address' in one
+// buffer and nothing else, it is kept as the reference for the parser benchmark.
+uint8_t parseUART(int address, uint8_t* rx_data, uint8_t rx_length, packet* rx_packet)
+{
+	uint8_t index;
+	// Make sure that the data buffer provided is long enough to contain a full packet
+	// The minimum packet length is 7 bytes
+	if (rx_length < 7)
+	{
+		//buffer length too short to contain a valid packet
+		return 0;		
+	}
+	
+	// Try to find the 'snp' start sequence for the packet
+	for (index = 0; index < (rx_length - 2); index++)
+    {
+		// Check for 'snp'. If found, immediately exit the loop
+		if (rx_data[index] == 's' && rx_data[index+1] == 'n' && rx_data[index+2] == 'p')
+		{
+			//found valid SNP
+			uint8_t packet_index = index;
+	
+			// Check to see if the variable 'packet_index' is equal to (rx_length - 2). If it is, then the above
+			// loop executed to completion and never found a packet header.
+			if (packet_index == (rx_length - 2))
+			{
+				return 0;
+			}
+			
+			// If we get here, a packet header was found. Now check to see if we have enough room
+			// left in the buffer to contain a full packet. Note that at this point, the variable 'packet_index'
+			// contains the location of the 's' character in the buffer (the first byte in the header)
+			if ((rx_length - packet_index) < 7)
+			{
+				return 0;
+			}
+			
+			// We've found a packet header, and there is enough space left in the buffer for at least
+			// the smallest allowable packet length (7 bytes). Pull out the packet type byte to determine
+			// the actual length of this packet
+			uint8_t PT = rx_data[packet_index + 3];
+
+			// Do some bit-level manipulation to determine if the packet contains data and if it is a batch
+			// We have to do this because the individual bits in the PT byte specify the contents of the
+			// packet.
+			uint8_t packet_has_data = (PT >> 7) & 0x01; // Check bit 7 (HAS_DATA)
+			uint8_t packet_is_batch = (PT >> 6) & 0x01; // Check bit 6 (IS_BATCH)
+			uint8_t batch_length = (PT >> 2) & 0x0F; // Extract the batch length (bits 2 through 5)
+
+			// Now finally figure out the actual packet length
+			uint8_t data_length = 0;
+			if (packet_has_data)
+			{
+				if (packet_is_batch)
+				{
+					// Packet has data and is a batch. This means it contains 'batch_length' registers, each
+					// of which has a length of 4 bytes
+					data_length = 4*batch_length;
+					//printf("Packet is batch, length = %i\n", (int)(data_length));
+				}
+				else // Packet has data but is not a batch. This means it contains one register (4 bytes)   
+				{
+					data_length = 4;
+				}
+			}
+			else // Packet has no data
+			{
+				data_length = 0;
+			}
+			
+			// At this point, we know exactly how long the packet is. Now we can check to make sure
+			// we have enough data for the full packet.
+			if( (rx_length - packet_index) < (data_length + 5) )
+			{
+				//printf("Not enough data for full packet!\n");
+				return 0;
+			}
+			
+			// If we get here, we know that we have a full packet in the buffer. All that remains is to pull
+			// out the data and make sure the checksum is good.
+			// Start by extracting all the data
+			rx_packet->address = rx_data[packet_index + 4];	
+			rx_packet->packet_type = PT;
+			
+			if (rx_packet->address != address)
+			{
+				//printf("Wrong packet address, looking again!\n");
+				//packet address does not match search address
+				//increase the loop index and look for a new valid packet
+				continue;
+			}
+			//printf("Found one!\n");
+
+			// Get the data bytes and compute the checksum all in one step
+			rx_packet->n_data_bytes = data_length;
+			uint16_t computed_checksum = 's' + 'n' + 'p' + rx_packet->packet_type + rx_packet->address;	
+			
+			for( int k = 0; k < data_length; k++ )
+			{
+				// Copy the data into the packet structure's data array
+				rx_packet->data[k] = rx_data[packet_index + 5 + k];
+				// Add the new byte to the checksum
+				computed_checksum += rx_packet->data[k];		
+			}    
+		   
+			// Now see if our computed checksum matches the received checksum
+			// First extract the checksum from the packet
+			uint16_t received_checksum = (rx_data[packet_index + 5 + data_length] << 8);
+
+			received_checksum |= rx_data[packet_index + 6 + data_length];
+			// Now check to see if they don't match
+			if (received_checksum != computed_checksum)
+			{
+				//checksum is bad
+				//increase the loop index and look for a new valid packet
+				return 0;
+			}
+			
+			//printf("checksum good!\n");
+			rx_packet->checksum = computed_checksum;
+			// At this point, we've received a full packet with a good checksum. It is already
+			// fully parsed and copied to the packet structure, so return 0 to indicate that a packet was
+			// processed.
+			return 1;			
+		}
+    }    
+    
+    return 0;	
+}
@@ -0,0 +1,34 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "um7.h"
+
+#define PARSER_RING_SIZE		8192	//must be a power of two
+#define PARSER_RING_MASK		(PARSER_RING_SIZE - 1)
+#define MIN_PACKET_LENGTH		7		//'snp' + PT + address + checksum
+#define MAX_PACKET_LENGTH		(MIN_PACKET_LENGTH + MAX_PACKET_DATA)
+
+//streaming packet parser running over a persistent ring buffer, bytes that
+//do not yet form a complete packet are kept until the next push
+typedef struct 
+{
+  uint8_t ring[PARSER_RING_SIZE];
+  uint32_t head;						//free-running write position
+  uint32_t tail;						//free-running search position
+  uint32_t packets;
+  uint32_t checksum_errors;
+  uint32_t skipped_bytes;
+  uint32_t dropped_bytes;
+} parser;
+
+void initParser(parser* p);
+uint32_t parserPush(parser* p, const uint8_t* data, uint32_t length);
+int parserNext(parser* p, packet* rx_packet);
+uint32_t parserPending(const parser* p);
+uint8_t encodePacket(const packet* tx_packet, uint8_t* buffer);
+uint8_t parseUART(int address, uint8_t* rx_data, uint8_t rx_length, packet* rx_packet);
+
+#endif
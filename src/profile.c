@@ -0,0 +1,235 @@
+#include "profile.h"
+
+//rate encodings used by the CREG_COM_RATES fields
+#define RATE_HZ			0		//packets per second
+#define RATE_HEALTH		1		//code into health_rates
+#define RATE_NMEA		2		//code into nmea_rates
+
+typedef struct 
+{
+  const char* name;
+  uint8_t reg;					//CREG_COM_RATES1 = 0 .. CREG_COM_RATES7 = 6
+  uint8_t byte;					//byte of the register, most significant first
+  uint8_t shift;
+  uint8_t mask;
+  uint8_t encoding;
+  uint8_t packet_bytes;			//size of one broadcast packet on the wire
+} rate_field;
+
+//packet sizes are 7 bytes of framing plus 4 bytes per register, NMEA sizes
+//are typical sentence lengths
+static const rate_field fields[] = 
+{
+	{"raw_accel_rate", 		0, 0, 0, 0xFF, RATE_HZ, 	19},
+	{"raw_gyro_rate", 		0, 1, 0, 0xFF, RATE_HZ, 	19},
+	{"raw_mag_rate", 		0, 2, 0, 0xFF, RATE_HZ, 	19},
+	{"temp_rate", 			1, 0, 0, 0xFF, RATE_HZ, 	15},
+	{"all_raw_rate", 		1, 3, 0, 0xFF, RATE_HZ, 	43},
+	{"proc_accel_rate", 	2, 0, 0, 0xFF, RATE_HZ, 	23},
+	{"proc_gyro_rate", 		2, 1, 0, 0xFF, RATE_HZ, 	23},
+	{"proc_mag_rate", 		2, 2, 0, 0xFF, RATE_HZ, 	23},
+	{"all_proc_rate", 		3, 3, 0, 0xFF, RATE_HZ, 	55},
+	{"quat_rate", 			4, 0, 0, 0xFF, RATE_HZ, 	19},
+	{"euler_rate", 			4, 1, 0, 0xFF, RATE_HZ, 	27},
+	{"position_rate", 		4, 2, 0, 0xFF, RATE_HZ, 	23},
+	{"velocity_rate", 		4, 3, 0, 0xFF, RATE_HZ, 	23},
+	{"pose_rate", 			5, 0, 0, 0xFF, RATE_HZ, 	43},
+	{"health_rate", 		5, 1, 0, 0x0F, RATE_HEALTH, 11},
+	{"gyro_bias_rate", 		5, 2, 0, 0xFF, RATE_HZ, 	19},
+	{"nmea_health_rate", 	6, 0, 4, 0x0F, RATE_NMEA, 	50},
+	{"nmea_pose_rate", 		6, 0, 0, 0x0F, RATE_NMEA, 	90},
+	{"nmea_attitude_rate", 	6, 1, 4, 0x0F, RATE_NMEA, 	70},
+	{"nmea_sensor_rate", 	6, 1, 0, 0x0F, RATE_NMEA, 	110},
+	{"nmea_rates_rate", 	6, 2, 4, 0x0F, RATE_NMEA, 	60},
+	{"nmea_gps_pose_rate", 	6, 2, 0, 0x0F, RATE_NMEA, 	90},
+	{"nmea_quat_rate", 		6, 3, 4, 0x0F, RATE_NMEA, 	70},
+};
+
+#define N_FIELDS (sizeof(fields)/sizeof(rate_field))
+
+static const double health_rates[16] = {0, 0.125, 0.25, 0.5, 1, 2, 4};
+static const double nmea_rates[16] = {0, 1, 2, 4, 5, 10, 15, 20, 30, 40, 50, 60, 70, 80, 90, 100};
+static const int baud_rates[] = {9600, 14400, 19200, 38400, 57600, 115200, 128000, 153600, 230400, 256000, 460800, 921600};
+
+//the configuration initIMU has always written: slow health packets and a 
+//few NMEA sentences at 115200 baud
+void initProfile(rate_profile* profile)
+{
+	memset(profile, 0, sizeof(rate_profile));
+	
+	profile->baud_rate = 115200;
+	profile->rates[5][1] = 1;
+	profile->rates[6][0] = (1 << 0) + (1 << 4);
+	profile->rates[6][2] = (1 << 0) + (1 << 4);
+}
+
+
+//index of 'baud_rate' in the CREG_COM_SETTINGS baud table, -1 if unsupported
+int baudRateCode(int baud_rate)
+{
+	for (int i = 0; i < sizeof(baud_rates)/sizeof(int); i++)
+	{
+		if (baud_rates[i] == baud_rate)
+		{
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+
+int setProfileField(rate_profile* profile, const char* name, const char* value)
+{
+	if (strcmp(name, "baud_rate") == 0)
+	{
+		profile->baud_rate = atoi(value);
+		return baudRateCode(profile->baud_rate) >= 0;
+	}
+	
+	for (int i = 0; i < N_FIELDS; i++)
+	{
+		if (strcmp(fields[i].name, name) == 0)
+		{
+			int code = atoi(value);
+			
+			if (code < 0 || code > fields[i].mask)
+			{
+				return 0;
+			}
+			
+			uint8_t* byte = &profile->rates[fields[i].reg][fields[i].byte];
+			*byte = (*byte & ~(fields[i].mask << fields[i].shift)) | (code << fields[i].shift);
+			
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+
+//reads 'name = value' lines, '#' starts a comment
+int loadProfile(rate_profile* profile, const char* path)
+{
+	FILE* file = fopen(path, "r");
+	char line[128];
+	int line_number = 0;
+	
+	if (!file)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open profile %s.\n", path);
+		return 0;
+	}
+	
+	while (fgets(line, sizeof(line), file))
+	{
+		char name[64];
+		char value[32];
+		
+		line_number++;
+		
+		char* comment = strchr(line, '#');
+		
+		if (comment)
+		{
+			*comment = '\0';
+		}
+		
+		char* equals = strchr(line, '=');
+		
+		if (equals)
+		{
+			*equals = ' ';
+		}
+		
+		int n = sscanf(line, "%63s %31s", name, value);
+		
+		if (n <= 0)
+		{
+			continue;
+		}
+		
+		if (n != 2 || !setProfileField(profile, name, value))
+		{
+			cprint("[!!] ", BRIGHT, RED);
+			printf("%s:%i: bad setting '%s'.\n", path, line_number, name);
+			fclose(file);
+			return 0;
+		}
+	}
+	
+	fclose(file);
+	
+	return 1;
+}
+
+
+static double fieldRate(const rate_profile* profile, const rate_field* field)
+{
+	int code = (profile->rates[field->reg][field->byte] >> field->shift) & field->mask;
+	
+	switch (field->encoding)
+	{
+		case RATE_HEALTH:
+			return health_rates[code];
+		case RATE_NMEA:
+			return nmea_rates[code];
+		default:
+			return code;
+	}
+}
+
+
+//fraction of the link capacity the broadcast packets will use
+double profileUtilisation(const rate_profile* profile)
+{
+	double bytes_per_second = 0;
+	
+	for (int i = 0; i < N_FIELDS; i++)
+	{
+		bytes_per_second += fieldRate(profile, &fields[i])*fields[i].packet_bytes;
+	}
+	
+	return bytes_per_second*UART_FRAME_BITS/profile->baud_rate;
+}
+
+
+int checkProfile(const rate_profile* profile)
+{
+	if (baudRateCode(profile->baud_rate) < 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Unsupported baud rate %i.\n", profile->baud_rate);
+		return 0;
+	}
+	
+	double utilisation = profileUtilisation(profile);
+	
+	if (utilisation > PROFILE_MAX_UTILISATION)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Profile needs %.0f%% of the link at %i baud, the limit is %.0f%%.\n", utilisation*100, profile->baud_rate, PROFILE_MAX_UTILISATION*100);
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+void printProfile(const rate_profile* profile)
+{
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("Profile: %i baud, %.1f%% link utilisation.\n", profile->baud_rate, profileUtilisation(profile)*100);
+	
+	for (int i = 0; i < N_FIELDS; i++)
+	{
+		double rate = fieldRate(profile, &fields[i]);
+		
+		if (rate > 0)
+		{
+			printf("%s: \t%g Hz\n", fields[i].name, rate);
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "um7.h"
+#include "colour.h"
+
+#define PROFILE_MAX_UTILISATION	0.9		//headroom left on the link for register traffic
+#define PROFILE_GPS_BAUD		4		//57600 on the auxiliary port
+#define UART_FRAME_BITS			10		//start + 8 data + stop
+
+//broadcast configuration of the UM7 main port
+typedef struct 
+{
+  int baud_rate;						//used by the UM7 and the host
+  uint8_t rates[7][4];					//CREG_COM_RATES1 to CREG_COM_RATES7
+} rate_profile;
+
+void initProfile(rate_profile* profile);
+int setProfileField(rate_profile* profile, const char* name, const char* value);
+int loadProfile(rate_profile* profile, const char* path);
+int baudRateCode(int baud_rate);
+double profileUtilisation(const rate_profile* profile);
+int checkProfile(const rate_profile* profile);
+void printProfile(const rate_profile* profile);
+
+#endif
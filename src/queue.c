@@ -0,0 +1,58 @@
+#include "queue.h"
+
+void initQueue(packet_queue* q)
+{
+	memset(q, 0, sizeof(packet_queue));
+}
+
+
+uint32_t queueOccupancy(packet_queue* q)
+{
+	uint32_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	
+	return head - tail;
+}
+
+
+//producer side, never blocks: a full queue drops the packet and counts it
+int queuePush(packet_queue* q, const packet* item)
+{
+	uint32_t head = q->head;
+	uint32_t used = head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+	
+	if (used == QUEUE_SIZE)
+	{
+		__atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	
+	q->items[head & QUEUE_MASK] = *item;
+	__atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+	
+	if (used + 1 > q->high_water)
+	{
+		__atomic_store_n(&q->high_water, used + 1, __ATOMIC_RELAXED);
+	}
+	
+	return 1;
+}
+
+
+//consumer side, copies out up to 'max_items' packets in one pass
+int queuePop(packet_queue* q, packet* items, int max_items)
+{
+	uint32_t tail = q->tail;
+	uint32_t available = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - tail;
+	int n = 0;
+	
+	while (n < max_items && (uint32_t)n < available)
+	{
+		items[n] = q->items[(tail + n) & QUEUE_MASK];
+		n++;
+	}
+	
+	__atomic_store_n(&q->tail, tail + n, __ATOMIC_RELEASE);
+	
+	return n;
+}
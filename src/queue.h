@@ -0,0 +1,30 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "um7.h"
+
+#define QUEUE_SIZE				1024	//packets, must be a power of two
+#define QUEUE_MASK				(QUEUE_SIZE - 1)
+#define QUEUE_BATCH				64		//packets drained per writer pass
+#define QUEUE_DRAIN_INTERVAL	10000	//writer sleep in us when the queue is empty
+
+//lock-free single-producer/single-consumer packet ring, the reader thread
+//owns 'head' and the counters, the writer thread owns 'tail'
+typedef struct 
+{
+  packet items[QUEUE_SIZE];
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t high_water;
+  uint32_t dropped;
+  uint32_t tail __attribute__((aligned(64)));
+} packet_queue;
+
+void initQueue(packet_queue* q);
+int queuePush(packet_queue* q, const packet* item);
+int queuePop(packet_queue* q, packet* items, int max_items);
+uint32_t queueOccupancy(packet_queue* q);
+
+#endif
@@ -0,0 +1,114 @@
+#include "reactor.h"
+
+int initReactor(reactor* r)
+{
+	memset(r, 0, sizeof(reactor));
+	r->epoll_fd = epoll_create1(0);
+	
+	if (r->epoll_fd < 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not create the device reactor: %s.\n", strerror(errno));
+		return 0;
+	}
+	
+	return 1;
+}
+
+
+int addDevice(reactor* r, imu_device* dev)
+{
+	struct epoll_event event;
+	
+	if (r->n_devices == REACTOR_MAX_DEVICES)
+	{
+		return 0;
+	}
+	
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = dev;
+	
+	if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, dev->fd, &event) != 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not watch device %i: %s.\n", dev->index, strerror(errno));
+		return 0;
+	}
+	
+	r->devices[r->n_devices++] = dev;
+	
+	return 1;
+}
+
+
+//sleeps until any port has data or 'timeout_ms' passes, then reads and 
+//processes every port that is ready. With 'low_water' above one byte the 
+//reads wait for that many more byte times first, so fast links hand over
+//several packets per wakeup. Returns the number of packets.
+int runReactor(reactor* r, int low_water, int timeout_ms)
+{
+	struct epoll_event events[REACTOR_MAX_DEVICES];
+	int packets = 0;
+	
+	int n = epoll_wait(r->epoll_fd, events, REACTOR_MAX_DEVICES, timeout_ms);
+	
+	if (n <= 0)
+	{
+		return 0;
+	}
+	
+	r->wakeups++;
+	
+	//the fastest ready port sets the wait, so none gathers much past low_water
+	if (low_water > 1)
+	{
+		uint64_t byte_time = uartByteTime(events[0].data.ptr);
+		
+		for (int i = 1; i < n; i++)
+		{
+			uint64_t t = uartByteTime(events[i].data.ptr);
+			byte_time = (t < byte_time) ? t : byte_time;
+		}
+		
+		usleep((low_water - 1)*byte_time/1000);
+	}
+	
+	for (int i = 0; i < n; i++)
+	{
+		imu_device* dev = events[i].data.ptr;
+		int bytes_read = getUART(dev);
+		
+		packets += processUART(dev, bytes_read, hostTime());
+	}
+	
+	return packets;
+}
+
+
+//reads and processes every port without waiting, for fixed-period reads
+int pollReactor(reactor* r)
+{
+	int packets = 0;
+	
+	for (int i = 0; i < r->n_devices; i++)
+	{
+		imu_device* dev = r->devices[i];
+		int bytes_read = getUART(dev);
+		
+		if (bytes_read > 0)
+		{
+			packets += processUART(dev, bytes_read, hostTime());
+		}
+	}
+	
+	r->wakeups++;
+	
+	return packets;
+}
+
+
+void closeReactor(reactor* r)
+{
+	close(r->epoll_fd);
+}
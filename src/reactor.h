@@ -0,0 +1,31 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "imu.h"
+
+#define REACTOR_MAX_DEVICES		8
+
+//one thread services every serial port: a single epoll wait, then a read
+//of each port that has data, so each device costs the same fixed work
+typedef struct
+{
+  int epoll_fd;
+  imu_device* devices[REACTOR_MAX_DEVICES];
+  int n_devices;
+  uint64_t wakeups;
+} reactor;
+
+int initReactor(reactor* r);
+int addDevice(reactor* r, imu_device* dev);
+int runReactor(reactor* r, int low_water, int timeout_ms);
+int pollReactor(reactor* r);
+void closeReactor(reactor* r);
+
+#endif
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+
+#include "realtime.h"
+
+//SCHED_FIFO for the calling thread, needs root or CAP_SYS_NICE
+int setRealtimePriority(int priority)
+{
+	struct sched_param param;
+	
+	param.sched_priority = priority;
+	
+	int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	
+	if (error)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not set SCHED_FIFO priority %i: %s.\n", priority, strerror(error));
+		return 0;
+	}
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Acquisition thread at SCHED_FIFO priority %i.\n", priority);
+	
+	return 1;
+}
+
+
+//pins the calling thread to one CPU
+int setCpuAffinity(int cpu)
+{
+	cpu_set_t cpus;
+	
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	
+	int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+	
+	if (error)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not pin the acquisition thread to CPU %i: %s.\n", cpu, strerror(error));
+		return 0;
+	}
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Acquisition thread pinned to CPU %i.\n", cpu);
+	
+	return 1;
+}
+
+
+//keeps every page of the process resident, now and later, and stops malloc
+//from handing memory back to the kernel or using fresh mmaps, either of 
+//which would page fault on the acquisition path
+int lockMemory(void)
+{
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not lock memory: %s.\n", strerror(errno));
+		return 0;
+	}
+	
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Memory locked.\n");
+	
+	return 1;
+}
+
+
+//writes one byte in every page so the first real access does not fault
+void prefault(void* buffer, size_t size)
+{
+	volatile uint8_t* bytes = buffer;
+	long page = sysconf(_SC_PAGESIZE);
+	
+	for (size_t i = 0; i < size; i += page)
+	{
+		bytes[i] = bytes[i];
+	}
+}
+
+
+void prefaultStack(void)
+{
+	uint8_t stack[REALTIME_STACK_PREFAULT];
+	
+	prefault(stack, sizeof(stack));
+}
+
+
+void initCycle(realtime_cycle* cycle, uint64_t period)
+{
+	memset(cycle, 0, sizeof(realtime_cycle));
+	initHistogram(&cycle->wakeup);
+	
+	cycle->period = period;
+	clock_gettime(CLOCK_MONOTONIC, &cycle->next);
+}
+
+
+static uint64_t toNanoseconds(const struct timespec* t)
+{
+	return (uint64_t)t->tv_sec*1000000000ULL + t->tv_nsec;
+}
+
+
+//sleeps until the next period boundary and returns how late the wakeup
+//was. A wakeup later than a whole period counts as an overrun and the 
+//schedule restarts from now rather than firing the missed cycles back to back.
+uint64_t waitCycle(realtime_cycle* cycle)
+{
+	struct timespec now;
+	uint64_t next = toNanoseconds(&cycle->next) + cycle->period;
+	
+	cycle->next.tv_sec = next/1000000000ULL;
+	cycle->next.tv_nsec = next%1000000000ULL;
+	
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &cycle->next, NULL) == EINTR);
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	uint64_t late = (toNanoseconds(&now) > next) ? toNanoseconds(&now) - next : 0;
+	
+	recordHistogram(&cycle->wakeup, late);
+	
+	if (late > cycle->period)
+	{
+		__atomic_store_n(&cycle->overruns, cycle->overruns + 1, __ATOMIC_RELAXED);
+		cycle->next = now;
+	}
+	
+	return late;
+}
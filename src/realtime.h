@@ -0,0 +1,39 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "colour.h"
+#include "histogram.h"
+
+#define REALTIME_PERIOD_NS		1000000ULL	//acquisition cycle, 92 bytes at 921600 baud
+#define REALTIME_STACK_PREFAULT	(64*1024)	//stack touched before the first cycle
+
+//fixed-period wakeups of the acquisition thread and how late they were
+typedef struct
+{
+  struct timespec next;					//CLOCK_MONOTONIC time of the next wakeup
+  uint64_t period;						//nanoseconds
+  uint64_t overruns;					//wakeups so late the next one was already due
+  latency_histogram wakeup;				//nanoseconds each wakeup was late
+} realtime_cycle;
+
+int setRealtimePriority(int priority);
+int setCpuAffinity(int cpu);
+int lockMemory(void);
+void prefault(void* buffer, size_t size);
+void prefaultStack(void);
+
+void initCycle(realtime_cycle* cycle, uint64_t period);
+uint64_t waitCycle(realtime_cycle* cycle);
+
+#endif
@@ -0,0 +1,338 @@
+#include "resample.h"
+
+//the sample groups that are resampled, where their values and stamps live
+//and where the interpolated values go
+static const struct
+{
+  uint32_t group;
+  int components;
+  size_t value;
+  size_t stamp;
+  size_t out;
+} resampled_groups[RESAMPLE_TRACKS] =
+{
+	{DECODED_QUAT, 		4, 	offsetof(imu_state, quat.a), 			offsetof(imu_state, quat.stamp), 		offsetof(resampled_state, quat)},
+	{DECODED_EULER, 	3, 	offsetof(imu_state, euler.roll_rate), 	offsetof(imu_state, euler.stamp), 		offsetof(resampled_state, rates)},
+	{DECODED_GYRO, 		3, 	offsetof(imu_state, gyro.x), 			offsetof(imu_state, gyro.stamp), 		offsetof(resampled_state, gyro)},
+	{DECODED_POSITION, 	3, 	offsetof(imu_state, position.x), 		offsetof(imu_state, position.stamp), 	offsetof(resampled_state, position)},
+	{DECODED_VELOCITY, 	3, 	offsetof(imu_state, velocity.x), 		offsetof(imu_state, velocity.stamp), 	offsetof(resampled_state, velocity)},
+};
+
+//coefficients of Eberly's polynomial slerp, "A Fast and Accurate Algorithm
+//for Computing SLERP" (2011): 1/(i(2i+1)) and i/(2i+1), the last pair scaled
+//to spread the truncation error
+#define SLERP_MU	1.90110745351730037f
+
+static const float slerp_u[8] = {1.0f/3, 1.0f/10, 1.0f/21, 1.0f/36, 1.0f/55, 1.0f/78, 1.0f/105, SLERP_MU/136};
+static const float slerp_v[8] = {1.0f/3, 2.0f/5, 3.0f/7, 4.0f/9, 5.0f/11, 6.0f/13, 7.0f/15, SLERP_MU*8/17};
+
+//sin(t*angle)/sin(angle) as a series in cos(angle) - 1, written out so it
+//unrolls into the kernel loop
+static inline float slerpWeight(float t, float xm1)
+{
+	float t2 = t*t;
+	float f = 1.0f + (slerp_u[7]*t2 - slerp_v[7])*xm1;
+
+	f = 1.0f + (slerp_u[6]*t2 - slerp_v[6])*xm1*f;
+	f = 1.0f + (slerp_u[5]*t2 - slerp_v[5])*xm1*f;
+	f = 1.0f + (slerp_u[4]*t2 - slerp_v[4])*xm1*f;
+	f = 1.0f + (slerp_u[3]*t2 - slerp_v[3])*xm1*f;
+	f = 1.0f + (slerp_u[2]*t2 - slerp_v[2])*xm1*f;
+	f = 1.0f + (slerp_u[1]*t2 - slerp_v[1])*xm1*f;
+	f = 1.0f + (slerp_u[0]*t2 - slerp_v[0])*xm1*f;
+
+	return t*f;
+}
+
+
+void initResampler(resampler* r, int mode)
+{
+	memset(r, 0, sizeof(resampler));
+	r->mode = mode;
+}
+
+
+static uint32_t kept(const resample_track* track)
+{
+	return (track->count < RESAMPLE_HISTORY) ? track->count : RESAMPLE_HISTORY;
+}
+
+
+//ring position of the i-th oldest sample still kept
+static uint32_t position(const resample_track* track, uint32_t i)
+{
+	return (track->count - kept(track) + i) & (RESAMPLE_HISTORY - 1);
+}
+
+
+static uint64_t newest(const resample_track* track)
+{
+	return track->time[(track->count - 1) & (RESAMPLE_HISTORY - 1)];
+}
+
+
+//takes the groups a packet updated. A stamp that runs backwards further than
+//a stale gap means the clock fit was reset, the history starts over.
+void addResampleSamples(resampler* r, const imu_state* state, uint32_t updated)
+{
+	for (int k = 0; k < RESAMPLE_TRACKS; k++)
+	{
+		if (!(updated & resampled_groups[k].group))
+		{
+			continue;
+		}
+
+		resample_track* track = &r->tracks[k];
+		const sample_stamp* stamp = (const sample_stamp*)((const uint8_t*)state + resampled_groups[k].stamp);
+		uint64_t time = (stamp->aligned) ? stamp->aligned : stamp->host;
+
+		if (track->count && time <= newest(track))
+		{
+			if (newest(track) - time < RESAMPLE_STALE_NS)
+			{
+				continue;
+			}
+
+			track->count = 0;
+		}
+
+		uint32_t i = track->count & (RESAMPLE_HISTORY - 1);
+
+		track->time[i] = time;
+		memcpy(track->value[i], (const uint8_t*)state + resampled_groups[k].value, resampled_groups[k].components*sizeof(float));
+		track->count++;
+	}
+}
+
+
+//whether every group has seen past 'time', so it can be resampled now and
+//give what it would in hindsight. Cubic needs one more sample for the tangent.
+//A group more than a stale gap behind the others has stopped and is not
+//waited for.
+int isResampleReady(const resampler* r, uint64_t time)
+{
+	uint64_t latest = 0;
+
+	for (int k = 0; k < RESAMPLE_TRACKS; k++)
+	{
+		if (r->tracks[k].count && newest(&r->tracks[k]) > latest)
+		{
+			latest = newest(&r->tracks[k]);
+		}
+	}
+
+	for (int k = 0; k < RESAMPLE_TRACKS; k++)
+	{
+		const resample_track* track = &r->tracks[k];
+
+		if (!track->count || newest(track) + RESAMPLE_STALE_NS < latest)
+		{
+			continue;
+		}
+
+		uint32_t ahead = (r->mode == RESAMPLE_CUBIC) ? 2 : 1;
+
+		if (kept(track) < ahead || track->time[position(track, kept(track) - ahead)] <= time)
+		{
+			return 0;
+		}
+	}
+
+	return latest != 0;
+}
+
+
+//index of the last kept sample at or before 'time', -1 if 'time' is outside
+//the samples kept
+static int bracket(const resample_track* track, uint64_t time)
+{
+	int n = kept(track);
+
+	if (n < 2 || time < track->time[position(track, 0)] || time > newest(track))
+	{
+		return -1;
+	}
+
+	int low = 0, high = n - 1;
+
+	while (high - low > 1)
+	{
+		int middle = (low + high)/2;
+
+		if (track->time[position(track, middle)] <= time)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+
+//component c of the slope at the i-th kept sample times 'h', from the
+//samples either side of it, one-sided at the ends
+static float tangent(const resample_track* track, int i, int c, double h)
+{
+	int n = kept(track);
+	int before = (i > 0) ? i - 1 : i;
+	int after = (i < n - 1) ? i + 1 : i;
+	uint32_t p0 = position(track, before), p1 = position(track, after);
+
+	return (track->value[p1][c] - track->value[p0][c])*h/(track->time[p1] - track->time[p0]);
+}
+
+
+//gathers the samples around each trigger into kernel columns
+static void gather(resampler* r, const resample_track* track, int components, const uint64_t* times, int n)
+{
+	for (int j = 0; j < n; j++)
+	{
+		int i = bracket(track, times[j]);
+
+		r->is_bracketed[j] = (i >= 0);
+
+		if (i < 0)
+		{
+			for (int c = 0; c < components; c++)
+			{
+				r->a[c][j] = r->b[c][j] = r->da[c][j] = r->db[c][j] = 0;
+			}
+
+			r->u[j] = 0;
+			continue;
+		}
+
+		uint32_t p0 = position(track, i), p1 = position(track, i + 1);
+		double h = track->time[p1] - track->time[p0];
+
+		r->u[j] = (times[j] - track->time[p0])/h;
+
+		for (int c = 0; c < components; c++)
+		{
+			r->a[c][j] = track->value[p0][c];
+			r->b[c][j] = track->value[p1][c];
+		}
+
+		if (r->mode == RESAMPLE_CUBIC)
+		{
+			for (int c = 0; c < components; c++)
+			{
+				r->da[c][j] = tangent(track, i, c, h);
+				r->db[c][j] = tangent(track, i + 1, c, h);
+			}
+		}
+	}
+}
+
+
+//interpolates every group at each of 'n' trigger times. Triggers are taken a
+//batch at a time: the samples around them are gathered into columns and each
+//kernel then runs straight down the columns.
+void resample(resampler* r, const uint64_t* times, int n, resampled_state* out)
+{
+	for (int start = 0; start < n; start += RESAMPLE_BATCH)
+	{
+		int m = (n - start < RESAMPLE_BATCH) ? n - start : RESAMPLE_BATCH;
+
+		for (int j = 0; j < m; j++)
+		{
+			memset(&out[start + j], 0, sizeof(resampled_state));
+			out[start + j].time = times[start + j];
+		}
+
+		for (int k = 0; k < RESAMPLE_TRACKS; k++)
+		{
+			int components = resampled_groups[k].components;
+
+			gather(r, &r->tracks[k], components, &times[start], m);
+
+			if (resampled_groups[k].group == DECODED_QUAT)
+			{
+				slerpKernel(r->out, r->a, r->b, r->u);
+			}
+			else if (r->mode == RESAMPLE_CUBIC)
+			{
+				hermiteKernel(components, r->out, r->a, r->b, r->da, r->db, r->u);
+			}
+			else
+			{
+				lerpKernel(components, r->out, r->a, r->b, r->u);
+			}
+
+			for (int j = 0; j < m; j++)
+			{
+				if (!r->is_bracketed[j])
+				{
+					continue;
+				}
+
+				float* values = (float*)((uint8_t*)&out[start + j] + resampled_groups[k].out);
+
+				for (int c = 0; c < components; c++)
+				{
+					values[c] = r->out[c][j];
+				}
+
+				out[start + j].valid |= resampled_groups[k].group;
+			}
+		}
+	}
+}
+
+
+//the kernels run down whole columns, a fixed count the compiler vectorises
+//without a scalar tail, and columns past the batch are simply not read back
+
+//slerp without acos, sin or a division, so the loop vectorises. q and -q are
+//the same attitude, the shorter way round is taken.
+void slerpKernel(float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH], const float* restrict u)
+{
+	for (int j = 0; j < RESAMPLE_BATCH; j++)
+	{
+		float x = a[0][j]*b[0][j] + a[1][j]*b[1][j] + a[2][j]*b[2][j] + a[3][j]*b[3][j];
+		float sign = copysignf(1.0f, x);
+		float xm1 = fabsf(x) - 1.0f;
+		float ct = sign*slerpWeight(u[j], xm1);
+		float cd = slerpWeight(1.0f - u[j], xm1);
+
+		for (int c = 0; c < 4; c++)
+		{
+			out[c][j] = cd*a[c][j] + ct*b[c][j];
+		}
+	}
+}
+
+
+void lerpKernel(int components, float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH], const float* restrict u)
+{
+	for (int c = 0; c < components; c++)
+	{
+		for (int j = 0; j < RESAMPLE_BATCH; j++)
+		{
+			out[c][j] = a[c][j] + u[j]*(b[c][j] - a[c][j]);
+		}
+	}
+}
+
+
+//cubic Hermite between a and b, da and db are the slopes at either end
+//scaled to the bracket
+void hermiteKernel(int components, float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH],
+	float da[4][RESAMPLE_BATCH], float db[4][RESAMPLE_BATCH], const float* restrict u)
+{
+	for (int c = 0; c < components; c++)
+	{
+		for (int j = 0; j < RESAMPLE_BATCH; j++)
+		{
+			float t = u[j];
+			float t2 = t*t;
+			float t3 = t2*t;
+
+			out[c][j] = (2*t3 - 3*t2 + 1)*a[c][j] + (t3 - 2*t2 + t)*da[c][j] + (3*t2 - 2*t3)*b[c][j] + (t3 - t2)*db[c][j];
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "decode.h"
+
+#define RESAMPLE_HISTORY		512		//samples kept per group, a power of two, seconds at UM7 broadcast rates
+#define RESAMPLE_BATCH			256		//trigger times interpolated per kernel pass
+#define RESAMPLE_TRACKS			5
+#define RESAMPLE_STALE_NS		500000000ULL	//a group this far behind a trigger is not waited for
+
+#define RESAMPLE_LINEAR			0
+#define RESAMPLE_CUBIC			1
+
+//the state at one trigger time. 'valid' holds the DECODED_* groups that had
+//samples on both sides of it, the others are zero.
+typedef struct
+{
+  uint64_t time;						//trigger, host clock
+  uint32_t valid;
+  float quat[4];						//slerp
+  float rates[3];						//euler rates, degrees per second
+  float gyro[3];						//degrees per second
+  float position[3];					//metres north, east, up of home
+  float velocity[3];					//metres per second north, east, up
+} resampled_state;
+
+//recent samples of one group, oldest overwritten first
+typedef struct
+{
+  uint64_t time[RESAMPLE_HISTORY];		//aligned stamp, the host stamp until the clock fit locks
+  float value[RESAMPLE_HISTORY][4];
+  uint32_t count;						//samples pushed since the last reset
+} resample_track;
+
+typedef struct
+{
+  resample_track tracks[RESAMPLE_TRACKS];
+  int mode;
+
+  //kernel operands, one row per component and one column per trigger
+  float a[4][RESAMPLE_BATCH];
+  float b[4][RESAMPLE_BATCH];
+  float da[4][RESAMPLE_BATCH];
+  float db[4][RESAMPLE_BATCH];
+  float out[4][RESAMPLE_BATCH];
+  float u[RESAMPLE_BATCH];				//fraction of the bracket each trigger is into
+  uint8_t is_bracketed[RESAMPLE_BATCH];
+} resampler;
+
+void initResampler(resampler* r, int mode);
+void addResampleSamples(resampler* r, const imu_state* state, uint32_t updated);
+int isResampleReady(const resampler* r, uint64_t time);
+void resample(resampler* r, const uint64_t* times, int n, resampled_state* out);
+
+void slerpKernel(float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH], const float* restrict u);
+void lerpKernel(int components, float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH], const float* restrict u);
+void hermiteKernel(int components, float out[restrict 4][RESAMPLE_BATCH], float a[4][RESAMPLE_BATCH], float b[4][RESAMPLE_BATCH],
+	float da[4][RESAMPLE_BATCH], float db[4][RESAMPLE_BATCH], const float* restrict u);
+
+#endif
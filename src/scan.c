@@ -0,0 +1,157 @@
+#include "scan.h"
+
+//three comparisons at every position, what the parsers did before
+uint32_t findHeaderScalar(const uint8_t* data, uint32_t length)
+{
+	if (length < 3)
+	{
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < length - 2; i++)
+	{
+		if (data[i] == 's' && data[i + 1] == 'n' && data[i + 2] == 'p')
+		{
+			return i;
+		}
+	}
+
+	return length - 2;
+}
+
+
+//libc's vectorised memchr finds each 's', only those are checked further
+uint32_t findHeaderMemchr(const uint8_t* data, uint32_t length)
+{
+	if (length < 3)
+	{
+		return 0;
+	}
+
+	uint32_t i = 0;
+
+	while (i < length - 2)
+	{
+		const uint8_t* s = memchr(&data[i], 's', length - 2 - i);
+
+		if (!s)
+		{
+			break;
+		}
+
+		i = s - data;
+
+		if (data[i + 1] == 'n' && data[i + 2] == 'p')
+		{
+			return i;
+		}
+
+		i++;
+	}
+
+	return length - 2;
+}
+
+
+//sixteen positions per step: the block compared with 's', the block one
+//byte on with 'n' and two on with 'p', a header is where all three agree
+uint32_t findHeader(const uint8_t* data, uint32_t length)
+{
+#if defined(__SSE2__)
+	const __m128i s = _mm_set1_epi8('s');
+	const __m128i n = _mm_set1_epi8('n');
+	const __m128i p = _mm_set1_epi8('p');
+	uint32_t i = 0;
+
+	for (; i + 18 <= length; i += 16)
+	{
+		__m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i]), s);
+		__m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 1]), n);
+		__m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&data[i + 2]), p);
+		int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+
+		if (mask)
+		{
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	return i + findHeaderScalar(&data[i], length - i);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const uint8x16_t s = vdupq_n_u8('s');
+	const uint8x16_t n = vdupq_n_u8('n');
+	const uint8x16_t p = vdupq_n_u8('p');
+	uint32_t i = 0;
+
+	for (; i + 18 <= length; i += 16)
+	{
+		uint8x16_t a = vceqq_u8(vld1q_u8(&data[i]), s);
+		uint8x16_t b = vceqq_u8(vld1q_u8(&data[i + 1]), n);
+		uint8x16_t c = vceqq_u8(vld1q_u8(&data[i + 2]), p);
+		uint8x16_t m = vandq_u8(vandq_u8(a, b), c);
+
+		//ARMv7 has no movemask, fold to 64 bits and only look closer on a hit
+		uint8x8_t folded = vorr_u8(vget_low_u8(m), vget_high_u8(m));
+
+		if (vget_lane_u64(vreinterpret_u64_u8(folded), 0))
+		{
+			return i + findHeaderScalar(&data[i], 18);
+		}
+	}
+
+	return i + findHeaderScalar(&data[i], length - i);
+#else
+	return findHeaderMemchr(data, length);
+#endif
+}
+
+
+uint16_t sumBytesScalar(const uint8_t* data, uint32_t length)
+{
+	uint16_t sum = 0;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		sum += data[i];
+	}
+
+	return sum;
+}
+
+
+uint16_t sumBytes(const uint8_t* data, uint32_t length)
+{
+	uint32_t i = 0;
+	uint16_t sum = 0;
+
+#if defined(__SSE2__)
+	//sum of absolute differences from zero adds each half of a block into
+	//its 64-bit lane, only the low 16 bits of either lane matter
+	__m128i total = _mm_setzero_si128();
+
+	for (; i + 16 <= length; i += 16)
+	{
+		total = _mm_add_epi64(total, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)&data[i]), _mm_setzero_si128()));
+	}
+
+	sum = _mm_cvtsi128_si32(total) + _mm_extract_epi16(total, 4);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	//pairs of bytes added into 16-bit lanes, which wrap as the checksum does
+	uint16x8_t total = vdupq_n_u16(0);
+	uint16_t lanes[8];
+
+	for (; i + 16 <= length; i += 16)
+	{
+		total = vpadalq_u8(total, vld1q_u8(&data[i]));
+	}
+
+	vst1q_u16(lanes, total);
+
+	for (int k = 0; k < 8; k++)
+	{
+		sum += lanes[k];
+	}
+#endif
+
+	return sum + sumBytesScalar(&data[i], length - i);
+}
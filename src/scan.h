@@ -0,0 +1,27 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_VECTOR				"sse2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SCAN_VECTOR				"neon"
+#else
+#define SCAN_VECTOR				"memchr"
+#endif
+
+//offset of the first 'snp' that starts before length - 2, length - 2 when
+//there is none: the bytes a parser can skip before it has to look itself
+uint32_t findHeader(const uint8_t* data, uint32_t length);
+uint32_t findHeaderMemchr(const uint8_t* data, uint32_t length);
+uint32_t findHeaderScalar(const uint8_t* data, uint32_t length);
+
+//sum of the bytes modulo 2^16, the UM7 packet checksum
+uint16_t sumBytes(const uint8_t* data, uint32_t length);
+uint16_t sumBytesScalar(const uint8_t* data, uint32_t length);
+
+#endif
@@ -0,0 +1,233 @@
+#include "shmring.h"
+
+static long futex(uint32_t* word, int op, uint32_t value, const struct timespec* timeout)
+{
+	return syscall(SYS_futex, word, op, value, timeout, NULL, 0);
+}
+
+
+//the sample ring of this process, NULL without shared memory: acquisition
+//carries on, only other processes cannot follow it. Readers write the
+//waiter count and the futex, so 'mode' needs write access for whoever
+//follows the ring. It is set past the umask.
+sample_ring* createRing(mode_t mode)
+{
+	int fd = shm_open(SHMRING_NAME, O_RDWR | O_CREAT | O_TRUNC, mode);
+
+	if (fd < 0 || fchmod(fd, mode) != 0)
+	{
+		perror("Sample ring shared memory");
+
+		if (fd >= 0)
+		{
+			close(fd);
+			shm_unlink(SHMRING_NAME);
+		}
+
+		return NULL;
+	}
+
+	if (ftruncate(fd, sizeof(sample_ring)) != 0)
+	{
+		perror("Sample ring shared memory");
+		close(fd);
+		shm_unlink(SHMRING_NAME);
+		return NULL;
+	}
+
+	sample_ring* ring = mmap(NULL, sizeof(sample_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ring == MAP_FAILED)
+	{
+		perror("Sample ring shared memory");
+		shm_unlink(SHMRING_NAME);
+		return NULL;
+	}
+
+	//a fresh object reads as zeros, touching it now keeps page faults out
+	//of the acquisition loop
+	memset(ring, 0, sizeof(sample_ring));
+
+	ring->version = SHMRING_VERSION;
+	ring->size = sizeof(sample_ring);
+	ring->slots = SHMRING_SLOTS;
+	ring->pid = getpid();
+
+	//the magic goes in last so a reader never takes a half-made ring
+	__atomic_store_n(&ring->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+	return ring;
+}
+
+
+//maps the ring of a running um7rp, NULL if there is none. Readers only ever
+//write the waiters count, the mapping is writable for that alone.
+sample_ring* openRing(void)
+{
+	int fd = shm_open(SHMRING_NAME, O_RDWR, 0);
+	struct stat st;
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(sample_ring))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	sample_ring* ring = mmap(NULL, sizeof(sample_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ring == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != SHMRING_MAGIC || ring->version != SHMRING_VERSION || ring->size != sizeof(sample_ring))
+	{
+		munmap(ring, sizeof(sample_ring));
+		return NULL;
+	}
+
+	return ring;
+}
+
+
+//the writer unlinks the name, readers still mapped keep what was published
+void closeRing(sample_ring* ring)
+{
+	int is_owner = (ring->pid == getpid());
+
+	munmap(ring, sizeof(sample_ring));
+
+	if (is_owner)
+	{
+		shm_unlink(SHMRING_NAME);
+	}
+}
+
+
+//writer side, one thread only. The slot is marked empty, filled, then given
+//its index, and only then does the head move past it.
+void publishSample(sample_ring* ring, uint32_t device, uint32_t updated, uint64_t timestamp, uint64_t decoded, const imu_state* state)
+{
+	uint64_t index = ring->head;
+	ring_slot* slot = &ring->slot[index & (SHMRING_SLOTS - 1)];
+
+	__atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->sample.index = index;
+	slot->sample.timestamp = timestamp;
+	slot->sample.decoded = decoded;
+	slot->sample.device = device;
+	slot->sample.updated = updated;
+	slot->sample.state = *state;
+
+	__atomic_store_n(&slot->sequence, index + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->head, index + 1, __ATOMIC_RELEASE);
+}
+
+
+//wakes sleeping readers once per read rather than once per packet, the
+//system call is skipped entirely while every reader is busy or spinning
+void notifyRing(sample_ring* ring)
+{
+	__atomic_store_n(&ring->futex, (uint32_t)ring->head, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&ring->waiters, __ATOMIC_SEQ_CST))
+	{
+		futex(&ring->futex, FUTEX_WAKE, INT_MAX, NULL);
+	}
+}
+
+
+//a reader starts at the next sample to be published, or at the oldest one
+//still in the ring
+void initRingReader(ring_reader* reader, sample_ring* ring, int is_oldest)
+{
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	reader->ring = ring;
+	reader->cursor = (is_oldest && head > SHMRING_SLOTS) ? head - SHMRING_SLOTS : (is_oldest ? 0 : head);
+	reader->lost = 0;
+}
+
+
+//copies the next sample, 0 when the reader has caught up. Samples the writer
+//reused the slots of before they were read are skipped and counted in 'lost'.
+int readSample(ring_reader* reader, ring_sample* sample)
+{
+	const sample_ring* ring = reader->ring;
+
+	while (1)
+	{
+		uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+		if (reader->cursor >= head)
+		{
+			return 0;
+		}
+
+		//lapped: everything older than one ring behind the head is gone
+		if (head - reader->cursor > SHMRING_SLOTS)
+		{
+			reader->lost += head - SHMRING_SLOTS - reader->cursor;
+			reader->cursor = head - SHMRING_SLOTS;
+		}
+
+		const ring_slot* slot = &ring->slot[reader->cursor & (SHMRING_SLOTS - 1)];
+		uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+		if (before == reader->cursor + 1)
+		{
+			*sample = slot->sample;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == before)
+			{
+				reader->cursor++;
+				return 1;
+			}
+		}
+
+		//the slot is already being reused, this sample is lost
+		reader->lost++;
+		reader->cursor++;
+	}
+}
+
+
+//as readSample, but sleeps up to 'timeout_ms' for the writer's next notify
+//(-1 waits for ever). Returns 0 on timeout.
+int waitSample(ring_reader* reader, ring_sample* sample, int timeout_ms)
+{
+	sample_ring* ring = reader->ring;
+	struct timespec timeout = {timeout_ms/1000, (timeout_ms % 1000)*1000000L};
+
+	if (readSample(reader, sample))
+	{
+		return 1;
+	}
+
+	__atomic_add_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+	//a notify between reading the futex word and sleeping changes the word,
+	//the kernel then returns at once instead of sleeping through it
+	uint32_t word = __atomic_load_n(&ring->futex, __ATOMIC_SEQ_CST);
+	int is_read = readSample(reader, sample);
+
+	if (!is_read)
+	{
+		futex(&ring->futex, FUTEX_WAIT, word, (timeout_ms < 0) ? NULL : &timeout);
+		is_read = readSample(reader, sample);
+	}
+
+	__atomic_sub_fetch(&ring->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return is_read;
+}
@@ -0,0 +1,76 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "decode.h"
+
+#define SHMRING_NAME			"/um7rp-samples"
+#define SHMRING_MAGIC			0x52374d55	//'UM7R'
+#define SHMRING_VERSION			1
+#define SHMRING_SLOTS			4096		//samples kept, a power of two, seconds of slack for a slow reader
+#define SHMRING_MODE			0666		//readers map the ring read-write to sleep on it
+
+//one decoded packet: the state right after it and the groups it updated
+typedef struct
+{
+  uint64_t index;						//samples published before this one
+  uint64_t timestamp;					//host time the packet's last byte arrived
+  uint64_t decoded;						//host time it was decoded and published
+  uint32_t device;						//position in the device list
+  uint32_t updated;						//DECODED_* groups of this packet
+  imu_state state;
+} ring_sample;
+
+typedef struct
+{
+  uint64_t sequence;					//index + 1 once the sample is whole, 0 while it is written
+  ring_sample sample;
+} __attribute__((aligned(64))) ring_slot;
+
+//single writer, any number of readers in any process. Readers keep their own
+//cursor and never write to the slots, so a slow reader cannot hold up the
+//acquisition thread: it is lapped, and finds out from the slot sequence.
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;						//sizeof(sample_ring) of the writer
+  uint32_t slots;
+  int32_t pid;
+
+  uint64_t head __attribute__((aligned(64)));	//samples published so far
+  uint32_t futex;						//low half of head at the last notify, readers sleep on it
+  uint32_t waiters;						//readers asleep or about to be
+
+  ring_slot slot[SHMRING_SLOTS];
+} sample_ring;
+
+typedef struct
+{
+  sample_ring* ring;
+  uint64_t cursor;						//index of the next sample to read
+  uint64_t lost;						//samples overwritten before they were read
+} ring_reader;
+
+sample_ring* createRing(mode_t mode);
+sample_ring* openRing(void);
+void closeRing(sample_ring* ring);
+void publishSample(sample_ring* ring, uint32_t device, uint32_t updated, uint64_t timestamp, uint64_t decoded, const imu_state* state);
+void notifyRing(sample_ring* ring);
+
+void initRingReader(ring_reader* reader, sample_ring* ring, int is_oldest);
+int readSample(ring_reader* reader, ring_sample* sample);
+int waitSample(ring_reader* reader, ring_sample* sample, int timeout_ms);
+
+#endif
@@ -0,0 +1,54 @@
+#include "snapshot.h"
+
+void initSnapshot(snapshot_lock* lock)
+{
+	memset(lock, 0, sizeof(snapshot_lock));
+}
+
+
+//writer side, one thread only
+void publishSnapshot(snapshot_lock* lock, const imu_state* state, uint64_t timestamp)
+{
+	uint32_t sequence = lock->sequence;
+	
+	__atomic_store_n(&lock->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	lock->snapshot.state = *state;
+	lock->snapshot.timestamp = timestamp;
+	lock->snapshot.version = sequence/2 + 1;
+	
+	__atomic_store_n(&lock->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+
+//copies the latest snapshot, any number of threads. A copy only repeats if
+//the writer published during it, which takes as long as one copy. Returns
+//the version of the copy, 0 if nothing has been published yet.
+uint32_t readSnapshot(const snapshot_lock* lock, imu_snapshot* snapshot)
+{
+	int spins = 0;
+	
+	while (1)
+	{
+		uint32_t before = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE);
+		
+		if (!(before & 1))
+		{
+			*snapshot = lock->snapshot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			
+			if (__atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) == before)
+			{
+				return snapshot->version;
+			}
+		}
+		
+		//a writer preempted mid-publish on this CPU needs the CPU back
+		if (++spins == SNAPSHOT_SPINS)
+		{
+			sched_yield();
+			spins = 0;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+
+#include "decode.h"
+
+#define SNAPSHOT_SPINS			1000	//retries before a reader yields to a preempted writer
+
+//everything decoded so far, as one consistent copy
+typedef struct
+{
+  imu_state state;
+  uint64_t timestamp;					//host time of the newest packet in 'state'
+  uint32_t version;						//publishes so far, unchanged means nothing new
+} imu_snapshot;
+
+//seqlock around the latest snapshot: the acquisition thread is the only
+//writer and never waits, readers copy and retry if a publish overlapped
+typedef struct
+{
+  uint32_t sequence __attribute__((aligned(64)));	//odd while a publish is in progress
+  imu_snapshot snapshot __attribute__((aligned(64)));
+} snapshot_lock;
+
+void initSnapshot(snapshot_lock* lock);
+void publishSnapshot(snapshot_lock* lock, const imu_state* state, uint64_t timestamp);
+uint32_t readSnapshot(const snapshot_lock* lock, imu_snapshot* snapshot);
+
+#endif
@@ -0,0 +1,293 @@
+#include "strapdown.h"
+
+#define DEG_TO_RAD			(M_PI/180.0)
+#define WGS84_A				6378137.0
+#define WGS84_E2			6.69437999014e-3
+
+void initStrapdown(strapdown* sd, const double* lever_arm)
+{
+	memset(sd, 0, sizeof(strapdown));
+	sd->quat[0] = 1;
+
+	if (lever_arm)
+	{
+		memcpy(sd->lever_arm, lever_arm, sizeof(sd->lever_arm));
+	}
+}
+
+
+//the aligned stamp once the clock fit has locked, the host stamp before
+static uint64_t stampTime(const sample_stamp* stamp)
+{
+	return (stamp->aligned) ? stamp->aligned : stamp->host;
+}
+
+
+static void quatMultiply(const double* p, const double* q, double* out)
+{
+	double r[4];
+
+	r[0] = p[0]*q[0] - p[1]*q[1] - p[2]*q[2] - p[3]*q[3];
+	r[1] = p[0]*q[1] + p[1]*q[0] + p[2]*q[3] - p[3]*q[2];
+	r[2] = p[0]*q[2] - p[1]*q[3] + p[2]*q[0] + p[3]*q[1];
+	r[3] = p[0]*q[3] + p[1]*q[2] - p[2]*q[1] + p[3]*q[0];
+
+	memcpy(out, r, sizeof(r));
+}
+
+
+static void quatNormalise(double* q)
+{
+	double norm = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+
+	for (int i = 0; i < 4; i++)
+	{
+		q[i] /= norm;
+	}
+}
+
+
+//q turned by the body frame rotation vector 'angle', radians
+static void quatTurn(double* q, const double* angle)
+{
+	double theta = sqrt(angle[0]*angle[0] + angle[1]*angle[1] + angle[2]*angle[2]);
+	double s = (theta > 1e-9) ? sin(theta/2)/theta : 0.5;
+	double dq[4] = {cos(theta/2), angle[0]*s, angle[1]*s, angle[2]*s};
+
+	quatMultiply(q, dq, q);
+	quatNormalise(q);
+}
+
+
+//body frame vector v in the navigation frame
+static void quatRotate(const double* q, const double* v, double* out)
+{
+	double t[3];
+
+	//v + 2w(u x v) + 2u x (u x v), u the vector part of q
+	t[0] = 2*(q[2]*v[2] - q[3]*v[1]);
+	t[1] = 2*(q[3]*v[0] - q[1]*v[2]);
+	t[2] = 2*(q[1]*v[1] - q[2]*v[0]);
+
+	out[0] = v[0] + q[0]*t[0] + q[2]*t[2] - q[3]*t[1];
+	out[1] = v[1] + q[0]*t[1] + q[3]*t[0] - q[1]*t[2];
+	out[2] = v[2] + q[0]*t[2] + q[1]*t[1] - q[2]*t[0];
+}
+
+
+//fraction of an error a filter with time constant 'tau' removes over 'dt'
+static double gain(uint64_t last, uint64_t now, double tau)
+{
+	double dt = (last && now > last) ? (now - last)*1e-9 : 0;
+
+	return (dt < tau) ? dt/tau : 1;
+}
+
+
+//the device quaternion seeds the attitude, then pulls it in slowly. What is
+//left over after that is put down to gyro bias.
+static void aidAttitude(strapdown* sd, const quat_sample* device)
+{
+	double q[4] = {device->a, device->b, device->c, device->d};
+	uint64_t time = stampTime(&device->stamp);
+
+	if (q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] < 0.5)
+	{
+		return;
+	}
+
+	quatNormalise(q);
+
+	if (!sd->is_aligned)
+	{
+		memcpy(sd->quat, q, sizeof(q));
+		sd->is_aligned = 1;
+		sd->quat_time = time;
+		return;
+	}
+
+	//body frame error from the integrated attitude to the device's
+	double conjugate[4] = {sd->quat[0], -sd->quat[1], -sd->quat[2], -sd->quat[3]};
+	double error[4];
+
+	quatMultiply(conjugate, q, error);
+
+	double sign = (error[0] < 0) ? -2 : 2;
+	double angle[3] = {sign*error[1], sign*error[2], sign*error[3]};
+	double k = gain(sd->quat_time, time, STRAPDOWN_ATTITUDE_TAU);
+	double dt = (sd->quat_time && time > sd->quat_time) ? (time - sd->quat_time)*1e-9 : 0;
+	double correction[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		correction[i] = k*angle[i];
+		sd->gyro_bias[i] -= angle[i]*dt/(STRAPDOWN_ATTITUDE_TAU*STRAPDOWN_BIAS_TAU);
+	}
+
+	quatTurn(sd->quat, correction);
+	sd->quat_time = time;
+}
+
+
+//GPS position relative to the first fix on a local flat earth, and the
+//horizontal velocity from speed over ground and course
+static void aidGPS(strapdown* sd, const gps_sample* gps)
+{
+	uint64_t time = stampTime(&gps->stamp);
+	double latitude = gps->latitude*DEG_TO_RAD, longitude = gps->longitude*DEG_TO_RAD;
+
+	if (!sd->has_origin)
+	{
+		sd->origin[0] = latitude;
+		sd->origin[1] = longitude;
+		sd->origin[2] = gps->altitude;
+		sd->has_origin = 1;
+	}
+
+	double s = sin(sd->origin[0]);
+	double w = sqrt(1 - WGS84_E2*s*s);
+	double meridian = WGS84_A*(1 - WGS84_E2)/(w*w*w);
+	double normal = WGS84_A/w;
+
+	double position[3] = {(latitude - sd->origin[0])*meridian, (longitude - sd->origin[1])*normal*cos(sd->origin[0]), sd->origin[2] - gps->altitude};
+	double velocity[2] = {gps->speed*cos(gps->course*DEG_TO_RAD), gps->speed*sin(gps->course*DEG_TO_RAD)};
+
+	double kp = gain(sd->fix_time, time, STRAPDOWN_POSITION_TAU);
+	double kv = gain(sd->fix_time, time, STRAPDOWN_VELOCITY_TAU);
+	double dt = (sd->fix_time && time > sd->fix_time) ? (time - sd->fix_time)*1e-9 : 0;
+
+	//the first fix is taken as it is
+	if (!sd->fix_time)
+	{
+		kp = kv = 1;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		double error = position[i] - sd->position[i];
+
+		sd->position[i] += kp*error;
+
+		//a position error that persists is a velocity error, vertically the
+		//only way it is corrected
+		sd->velocity[i] += error*dt/(STRAPDOWN_POSITION_TAU*STRAPDOWN_POSITION_TAU);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		sd->velocity[i] += kv*(velocity[i] - sd->velocity[i]);
+	}
+
+	sd->fix_time = time;
+}
+
+
+//one sensor period: attitude from the gyro, then the specific force turned
+//into the navigation frame at the middle of the period, gravity restored and
+//integrated twice
+static int step(strapdown* sd, const vector_sample* accel)
+{
+	uint64_t time = stampTime(&accel->stamp);
+
+	if (!sd->is_aligned)
+	{
+		return 0;
+	}
+
+	if (!sd->time || time <= sd->time || time - sd->time > STRAPDOWN_MAX_STEP*1e9)
+	{
+		sd->restarts += (sd->time != 0);
+		sd->time = time;
+		return 0;
+	}
+
+	double dt = (time - sd->time)*1e-9;
+	double angle[3], half[3], mid[4];
+	double force[3] = {accel->x*STRAPDOWN_GRAVITY, accel->y*STRAPDOWN_GRAVITY, accel->z*STRAPDOWN_GRAVITY};
+	double nav[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		angle[i] = (sd->gyro[i] - sd->gyro_bias[i])*dt;
+		half[i] = angle[i]/2;
+	}
+
+	memcpy(mid, sd->quat, sizeof(mid));
+	quatTurn(mid, half);
+	quatRotate(mid, force, nav);
+	quatTurn(sd->quat, angle);
+
+	nav[2] += STRAPDOWN_GRAVITY;
+
+	for (int i = 0; i < 3; i++)
+	{
+		sd->position[i] += sd->velocity[i]*dt + 0.5*nav[i]*dt*dt;
+		sd->velocity[i] += nav[i]*dt;
+	}
+
+	sd->time = time;
+	sd->steps++;
+
+	return 1;
+}
+
+
+//takes the groups one packet updated, returns 1 with 'pose' filled when the
+//packet carried an accel sample that moved the solution on
+int updateStrapdown(strapdown* sd, const imu_state* state, uint32_t updated, strapdown_pose* pose)
+{
+	if (updated & DECODED_QUAT)
+	{
+		aidAttitude(sd, &state->quat);
+	}
+
+	if ((updated & DECODED_GPS) && !state->health.gps_fail && (state->gps.latitude != 0 || state->gps.longitude != 0))
+	{
+		aidGPS(sd, &state->gps);
+	}
+
+	if (updated & DECODED_GYRO)
+	{
+		sd->gyro[0] = state->gyro.x*DEG_TO_RAD;
+		sd->gyro[1] = state->gyro.y*DEG_TO_RAD;
+		sd->gyro[2] = state->gyro.z*DEG_TO_RAD;
+	}
+
+	if ((updated & DECODED_ACCEL) && step(sd, &state->accel))
+	{
+		strapdownPose(sd, pose);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+//the solution moved from the UM7 to the phase centre, which also picks up
+//the velocity of the lever arm turning
+void strapdownPose(const strapdown* sd, strapdown_pose* pose)
+{
+	double arm[3], spin[3], spin_nav[3];
+	double rate[3] = {sd->gyro[0] - sd->gyro_bias[0], sd->gyro[1] - sd->gyro_bias[1], sd->gyro[2] - sd->gyro_bias[2]};
+	const double* l = sd->lever_arm;
+
+	spin[0] = rate[1]*l[2] - rate[2]*l[1];
+	spin[1] = rate[2]*l[0] - rate[0]*l[2];
+	spin[2] = rate[0]*l[1] - rate[1]*l[0];
+
+	quatRotate(sd->quat, l, arm);
+	quatRotate(sd->quat, spin, spin_nav);
+
+	pose->time = sd->time;
+
+	for (int i = 0; i < 4; i++)
+	{
+		pose->quat[i] = sd->quat[i];
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		pose->position[i] = sd->position[i] + arm[i];
+		pose->velocity[i] = sd->velocity[i] + spin_nav[i];
+	}
+}
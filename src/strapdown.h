@@ -0,0 +1,55 @@
+#ifndef STRAPDOWN_H
+#define STRAPDOWN_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "decode.h"
+
+#define STRAPDOWN_GRAVITY		9.80665		//m/s^2 per gravity the UM7 reports
+#define STRAPDOWN_MAX_STEP		0.1			//seconds between sensor samples that still integrate, longer restarts
+#define STRAPDOWN_ATTITUDE_TAU	2.0			//seconds for the device quaternion to pull the attitude in
+#define STRAPDOWN_BIAS_TAU		60.0		//seconds for the gyro bias to follow the attitude error
+#define STRAPDOWN_POSITION_TAU	2.0			//seconds for a GPS fix to pull the position in
+#define STRAPDOWN_VELOCITY_TAU	2.0			//seconds for the GPS speed and course to pull the velocity in
+
+//pose of the antenna phase centre, all in the north-east-down frame of the
+//first GPS fix
+typedef struct
+{
+  uint64_t time;						//host clock of the sensor sample
+  float quat[4];						//body to north-east-down, a b c d as the UM7 gives it
+  float position[3];					//metres
+  float velocity[3];					//metres per second
+} strapdown_pose;
+
+//integrates processed gyro and accel at the rate they come. The device
+//quaternion and GPS only correct it, through fixed-gain complementary
+//filters, so the state stays a fixed size and nothing is allocated.
+typedef struct
+{
+  double quat[4];						//body to north-east-down
+  double velocity[3];
+  double position[3];
+  double gyro_bias[3];					//radians per second
+  double lever_arm[3];					//body frame metres from the UM7 to the phase centre
+
+  double gyro[3];						//latest processed gyro, radians per second
+  uint64_t time;						//host clock of the last step, 0 before the first
+  int is_aligned;						//attitude seeded from the device quaternion
+
+  double origin[3];						//latitude, longitude (radians), altitude of the first fix
+  int has_origin;
+  uint64_t fix_time;					//host clock of the last GPS fix used
+  uint64_t quat_time;					//host clock of the last device quaternion used
+
+  uint64_t steps;
+  uint32_t restarts;					//gaps longer than STRAPDOWN_MAX_STEP
+} strapdown;
+
+void initStrapdown(strapdown* sd, const double* lever_arm);
+int updateStrapdown(strapdown* sd, const imu_state* state, uint32_t updated, strapdown_pose* pose);
+void strapdownPose(const strapdown* sd, strapdown_pose* pose);
+
+#endif
@@ -0,0 +1,213 @@
+#include "transaction.h"
+
+void initTransactions(transaction_set* set)
+{
+	memset(set, 0, sizeof(transaction_set));
+}
+
+
+//queues a register read (n_data_bytes = 0), write or command, returns NULL
+//when the set is full
+transaction* addTransaction(transaction_set* set, uint8_t address, uint8_t n_data_bytes, const uint8_t* data)
+{
+	if (set->count == TRANSACTION_SLOTS || n_data_bytes > MAX_PACKET_DATA)
+	{
+		return NULL;
+	}
+
+	transaction* t = &set->items[set->count++];
+
+	memset(t, 0, sizeof(transaction));
+	t->request.address = address;
+	t->request.n_data_bytes = n_data_bytes;
+	t->request.packet_type = (n_data_bytes != 0) ? PT_HAS_DATA : 0;
+
+	if (n_data_bytes != 0)
+	{
+		memcpy(t->request.data, data, n_data_bytes);
+	}
+	t->state = TRANSACTION_QUEUED;
+
+	return t;
+}
+
+
+//queues a read (data = NULL) or write of 'count' consecutive registers
+//carried in one packet
+transaction* addBatchTransaction(transaction_set* set, uint8_t address, int count, const uint8_t* data)
+{
+	if (count < 1 || count > MAX_BATCH_REGISTERS)
+	{
+		return NULL;
+	}
+
+	transaction* t = addTransaction(set, address, (data) ? 4*count : 0, data);
+
+	if (t && count > 1)
+	{
+		t->request.packet_type |= PT_IS_BATCH | (count << 2);
+	}
+
+	return t;
+}
+
+
+static int isAddressInFlight(const transaction_set* set, uint8_t address)
+{
+	for (int i = 0; i < set->count; i++)
+	{
+		if (set->items[i].state == TRANSACTION_IN_FLIGHT && set->items[i].request.address == address)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+//the next request to put on the wire, or NULL when the window is full or
+//everything left is waiting on an answer
+transaction* nextTransaction(transaction_set* set, uint64_t now)
+{
+	if (set->in_flight >= TRANSACTION_WINDOW)
+	{
+		return NULL;
+	}
+
+	for (int i = 0; i < set->count; i++)
+	{
+		transaction* t = &set->items[i];
+
+		if (t->state == TRANSACTION_QUEUED && !isAddressInFlight(set, t->request.address))
+		{
+			t->state = TRANSACTION_IN_FLIGHT;
+			t->deadline = now + TRANSACTION_TIMEOUT_NS;
+			t->attempts++;
+			set->in_flight++;
+
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+
+//completes the request a received packet answers. Writes are acknowledged
+//with an empty packet, which keeps broadcasts of the same register from
+//being taken for an ack. A late answer to an expired attempt still counts.
+transaction* matchTransaction(transaction_set* set, const packet* response)
+{
+	for (int i = 0; i < set->count; i++)
+	{
+		transaction* t = &set->items[i];
+
+		if (t->request.address != response->address || t->attempts == 0)
+		{
+			continue;
+		}
+
+		if (t->state != TRANSACTION_IN_FLIGHT && t->state != TRANSACTION_QUEUED)
+		{
+			continue;
+		}
+
+		if ((t->request.packet_type & PT_HAS_DATA) && (response->packet_type & PT_HAS_DATA))
+		{
+			continue;
+		}
+
+		//a batch read needs every register it asked for, a shorter broadcast
+		//starting at the same address is not the answer
+		if (!(t->request.packet_type & PT_HAS_DATA) && (t->request.packet_type & PT_IS_BATCH) && response->n_data_bytes < 4*((t->request.packet_type >> 2) & 0x0F))
+		{
+			continue;
+		}
+
+		if (t->state == TRANSACTION_IN_FLIGHT)
+		{
+			set->in_flight--;
+		}
+
+		t->response = *response;
+		t->state = TRANSACTION_DONE;
+		set->finished++;
+
+		return t;
+	}
+
+	return NULL;
+}
+
+
+//returns attempts past their deadline to the queue, or fails them once
+//they are out of attempts
+int expireTransactions(transaction_set* set, uint64_t now)
+{
+	int expired = 0;
+
+	for (int i = 0; i < set->count; i++)
+	{
+		transaction* t = &set->items[i];
+
+		if (t->state != TRANSACTION_IN_FLIGHT || t->deadline > now)
+		{
+			continue;
+		}
+
+		set->in_flight--;
+		expired++;
+
+		if (t->attempts >= TRANSACTION_ATTEMPTS)
+		{
+			t->state = TRANSACTION_FAILED;
+			set->finished++;
+			set->failed++;
+		}
+		else
+		{
+			t->state = TRANSACTION_QUEUED;
+		}
+	}
+
+	return expired;
+}
+
+
+//earliest deadline of the requests in flight, UINT64_MAX if there are none
+uint64_t transactionDeadline(const transaction_set* set)
+{
+	uint64_t deadline = UINT64_MAX;
+
+	for (int i = 0; i < set->count; i++)
+	{
+		if (set->items[i].state == TRANSACTION_IN_FLIGHT && set->items[i].deadline < deadline)
+		{
+			deadline = set->items[i].deadline;
+		}
+	}
+
+	return deadline;
+}
+
+
+int transactionsFinished(const transaction_set* set)
+{
+	return set->finished == set->count;
+}
+
+
+//the answered request to 'address', NULL if it failed or was never queued
+transaction* findTransaction(transaction_set* set, uint8_t address)
+{
+	for (int i = 0; i < set->count; i++)
+	{
+		if (set->items[i].state == TRANSACTION_DONE && set->items[i].request.address == address)
+		{
+			return &set->items[i];
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "um7.h"
+
+#define TRANSACTION_SLOTS		32		//requests one set can hold
+#define TRANSACTION_WINDOW		8		//requests in flight at once, the UM7 rx buffer is small
+#define TRANSACTION_TIMEOUT_NS	50000000ULL	//deadline of one attempt
+#define TRANSACTION_ATTEMPTS	100		//sends of one request before it fails
+
+#define TRANSACTION_QUEUED		0
+#define TRANSACTION_IN_FLIGHT	1
+#define TRANSACTION_DONE		2
+#define TRANSACTION_FAILED		3
+
+//one register read, write or command and the packet that answered it
+typedef struct
+{
+  packet request;
+  packet response;
+  uint64_t deadline;					//hostTime() at which an in-flight attempt expires
+  int attempts;
+  int state;
+} transaction;
+
+//requests are matched to responses by address, so only one request per
+//address is ever in flight and the rest of the window keeps moving
+typedef struct
+{
+  transaction items[TRANSACTION_SLOTS];
+  int count;
+  int in_flight;
+  int finished;
+  int failed;
+} transaction_set;
+
+void initTransactions(transaction_set* set);
+transaction* addTransaction(transaction_set* set, uint8_t address, uint8_t n_data_bytes, const uint8_t* data);
+transaction* addBatchTransaction(transaction_set* set, uint8_t address, int count, const uint8_t* data);
+transaction* nextTransaction(transaction_set* set, uint64_t now);
+transaction* matchTransaction(transaction_set* set, const packet* response);
+int expireTransactions(transaction_set* set, uint64_t now);
+uint64_t transactionDeadline(const transaction_set* set);
+int transactionsFinished(const transaction_set* set);
+transaction* findTransaction(transaction_set* set, uint8_t address);
+
+#endif
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "um7.h"
+#include "parser.h"
+#include "decode.h"
+#include "clock.h"
+#include "scan.h"
+
+#define DECODE_CHUNK_MB		4		//default bytes of capture per chunk
+#define MAX_THREADS			64
+#define MAX_FIELDS			7
+
+//the columns written for each sample group, one file per field
+static const struct
+{
+  const char* name;
+  uint32_t group;
+  int n_fields;
+  const char* fields[MAX_FIELDS];
+  size_t offsets[MAX_FIELDS];
+} column_groups[] =
+{
+	{"gyro", 		DECODED_GYRO, 		4, {"x", "y", "z", "time"},
+		{offsetof(imu_state, gyro.x), offsetof(imu_state, gyro.y), offsetof(imu_state, gyro.z), offsetof(imu_state, gyro.time)}},
+	{"accel", 		DECODED_ACCEL, 		4, {"x", "y", "z", "time"},
+		{offsetof(imu_state, accel.x), offsetof(imu_state, accel.y), offsetof(imu_state, accel.z), offsetof(imu_state, accel.time)}},
+	{"mag", 		DECODED_MAG, 		4, {"x", "y", "z", "time"},
+		{offsetof(imu_state, mag.x), offsetof(imu_state, mag.y), offsetof(imu_state, mag.z), offsetof(imu_state, mag.time)}},
+	{"quat", 		DECODED_QUAT, 		5, {"a", "b", "c", "d", "time"},
+		{offsetof(imu_state, quat.a), offsetof(imu_state, quat.b), offsetof(imu_state, quat.c), offsetof(imu_state, quat.d), offsetof(imu_state, quat.time)}},
+	{"euler", 		DECODED_EULER, 		7, {"roll", "pitch", "yaw", "roll_rate", "pitch_rate", "yaw_rate", "time"},
+		{offsetof(imu_state, euler.roll), offsetof(imu_state, euler.pitch), offsetof(imu_state, euler.yaw), offsetof(imu_state, euler.roll_rate),
+		offsetof(imu_state, euler.pitch_rate), offsetof(imu_state, euler.yaw_rate), offsetof(imu_state, euler.time)}},
+	{"position", 	DECODED_POSITION, 	4, {"north", "east", "up", "time"},
+		{offsetof(imu_state, position.x), offsetof(imu_state, position.y), offsetof(imu_state, position.z), offsetof(imu_state, position.time)}},
+	{"velocity", 	DECODED_VELOCITY, 	4, {"north", "east", "up", "time"},
+		{offsetof(imu_state, velocity.x), offsetof(imu_state, velocity.y), offsetof(imu_state, velocity.z), offsetof(imu_state, velocity.time)}},
+	{"gps", 		DECODED_GPS, 		6, {"latitude", "longitude", "altitude", "course", "speed", "time"},
+		{offsetof(imu_state, gps.latitude), offsetof(imu_state, gps.longitude), offsetof(imu_state, gps.altitude), offsetof(imu_state, gps.course),
+		offsetof(imu_state, gps.speed), offsetof(imu_state, gps.time)}},
+	{"temperature", DECODED_TEMPERATURE, 2, {"celsius", "time"},
+		{offsetof(imu_state, temperature), offsetof(imu_state, temperature_time)}},
+};
+
+#define N_GROUPS	(sizeof(column_groups)/sizeof(column_groups[0]))
+
+//a growable array of fixed-size values
+typedef struct
+{
+  uint8_t* data;
+  size_t n;
+  size_t capacity;
+} column;
+
+//rows of one group decoded from one chunk
+typedef struct
+{
+  column packet;						//uint64 packet number within the chunk
+  column offset;						//uint64 byte offset of the packet in the capture
+  column fields[MAX_FIELDS];			//float
+} group_rows;
+
+//a stretch of the capture decoded on its own. Its packets are those that
+//start inside it, the last may run into the next chunk.
+typedef struct
+{
+  uint64_t start;
+  uint64_t end;
+  uint64_t stop;						//where the scan went on from after the last packet
+  column packets;						//uint64 offset of every packet found
+  group_rows groups[N_GROUPS];
+} chunk;
+
+typedef struct
+{
+  const uint8_t* data;
+  uint64_t size;
+  chunk* chunks;
+  int n_chunks;
+  int next;								//next chunk of the wave to take, shared by the workers
+} wave;
+
+void help(void);
+void* decode_worker(void* arg);
+
+imu_state blank_state;
+
+static void push(column* c, const void* value, size_t width)
+{
+	if (c->n == c->capacity)
+	{
+		c->capacity = (c->capacity) ? 2*c->capacity : 1024;
+		c->data = realloc(c->data, c->capacity*width);
+
+		if (!c->data)
+		{
+			fprintf(stderr, "Out of memory.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	memcpy(&c->data[c->n*width], value, width);
+	c->n++;
+}
+
+
+//the first packet with a good checksum at or after 'offset' that starts
+//before 'limit', the same search the streaming parser makes. Returns its
+//length, 0 when there is none.
+static int scanPacket(const uint8_t* data, uint64_t size, uint64_t* offset, uint64_t limit)
+{
+	uint64_t end = (size + 1 > MIN_PACKET_LENGTH) ? size + 1 - MIN_PACKET_LENGTH : 0;
+
+	end = (end < limit) ? end : limit;
+
+	for (uint64_t i = *offset; i < end; i++)
+	{
+		//header candidates start before 'end', findHeader wants the two bytes after
+		uint64_t span = end - i + 2;
+		uint32_t skip = findHeader(&data[i], (span > UINT32_MAX) ? UINT32_MAX : span);
+
+		i += skip;
+
+		if (i >= end || data[i] != 's' || data[i + 1] != 'n' || data[i + 2] != 'p')
+		{
+			continue;
+		}
+
+		uint8_t PT = data[i + 3];
+		int length = MIN_PACKET_LENGTH;
+
+		if (PT & PT_HAS_DATA)
+		{
+			length += (PT & PT_IS_BATCH) ? 4*((PT >> 2) & 0x0F) : 4;
+		}
+
+		if (i + length > size)
+		{
+			return 0;
+		}
+
+		uint16_t checksum = sumBytes(&data[i], length - 2);
+
+		if (checksum == ((data[i + length - 2] << 8) | data[i + length - 1]))
+		{
+			*offset = i;
+			return length;
+		}
+	}
+
+	return 0;
+}
+
+
+//decodes one packet into rows of the groups it carries. Registers the
+//packet does not carry are NaN, so a row never depends on earlier packets
+//and any split of the capture gives the same columns.
+static void decodeRows(const uint8_t* data, uint64_t offset, uint64_t number, group_rows* groups)
+{
+	uint8_t PT = data[offset + 3];
+
+	if (!(PT & PT_HAS_DATA))
+	{
+		return;
+	}
+
+	imu_state state = blank_state;
+	int n_registers = (PT & PT_IS_BATCH) ? (PT >> 2) & 0x0F : 1;
+	uint32_t updated = decodeRegisters(data[offset + 4], &data[offset + 5], n_registers, &state);
+
+	for (int g = 0; g < N_GROUPS; g++)
+	{
+		if (!(updated & column_groups[g].group))
+		{
+			continue;
+		}
+
+		push(&groups[g].packet, &number, sizeof(uint64_t));
+		push(&groups[g].offset, &offset, sizeof(uint64_t));
+
+		for (int f = 0; f < column_groups[g].n_fields; f++)
+		{
+			push(&groups[g].fields[f], (uint8_t*)&state + column_groups[g].offsets[f], sizeof(float));
+		}
+	}
+}
+
+
+static void decodeChunk(const uint8_t* data, uint64_t size, chunk* c)
+{
+	uint64_t offset = c->start;
+	int length;
+
+	while ((length = scanPacket(data, size, &offset, c->end)))
+	{
+		push(&c->packets, &offset, sizeof(uint64_t));
+		decodeRows(data, offset, c->packets.n - 1, c->groups);
+		offset += length;
+	}
+
+	c->stop = (offset > c->end) ? offset : c->end;
+}
+
+
+void* decode_worker(void* arg)
+{
+	wave* w = arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED)) < w->n_chunks)
+	{
+		decodeChunk(w->data, w->size, &w->chunks[i]);
+	}
+
+	return NULL;
+}
+
+
+static FILE* columns[N_GROUPS][MAX_FIELDS + 2];
+static uint64_t rows[N_GROUPS];
+static uint64_t n_packets = 0;
+static uint64_t packet_bytes = 0;
+static uint64_t fixups = 0;
+
+static void openColumns(const char* dir)
+{
+	char path[512];
+
+	for (int g = 0; g < N_GROUPS; g++)
+	{
+		for (int f = 0; f < column_groups[g].n_fields + 2; f++)
+		{
+			if (f == 0)
+				snprintf(path, sizeof(path), "%s/%s.packet.u64", dir, column_groups[g].name);
+			else if (f == 1)
+				snprintf(path, sizeof(path), "%s/%s.offset.u64", dir, column_groups[g].name);
+			else
+				snprintf(path, sizeof(path), "%s/%s.%s.f32", dir, column_groups[g].name, column_groups[g].fields[f - 2]);
+
+			if (!(columns[g][f] = fopen(path, "wb")))
+			{
+				perror(path);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+
+//appends the rows of packets numbered 'first' onwards, renumbered to follow
+//the packets already written
+static void writeRows(group_rows* groups, uint64_t first, uint64_t base)
+{
+	for (int g = 0; g < N_GROUPS; g++)
+	{
+		group_rows* r = &groups[g];
+		const uint64_t* packet = (const uint64_t*)r->packet.data;
+		size_t i = 0;
+
+		while (i < r->packet.n && packet[i] < first)
+		{
+			i++;
+		}
+
+		for (size_t k = i; k < r->packet.n; k++)
+		{
+			uint64_t number = base + packet[k] - first;
+			fwrite(&number, sizeof(uint64_t), 1, columns[g][0]);
+		}
+
+		fwrite(&r->offset.data[i*sizeof(uint64_t)], sizeof(uint64_t), r->offset.n - i, columns[g][1]);
+
+		for (int f = 0; f < column_groups[g].n_fields; f++)
+		{
+			fwrite(&r->fields[f].data[i*sizeof(float)], sizeof(float), r->fields[f].n - i, columns[g][f + 2]);
+		}
+
+		rows[g] += r->packet.n - i;
+	}
+}
+
+
+static void clearGroups(group_rows* groups)
+{
+	for (int g = 0; g < N_GROUPS; g++)
+	{
+		groups[g].packet.n = groups[g].offset.n = 0;
+
+		for (int f = 0; f < MAX_FIELDS; f++)
+		{
+			groups[g].fields[f].n = 0;
+		}
+	}
+}
+
+
+//joins a chunk to what is written so far. 'resume' is where the sequential
+//scan would go on from. The chunk's own scan began at its start and may have
+//locked onto a false header inside a packet that ran over from before, so
+//packets are scanned one at a time from 'resume' until one of them is also
+//one of the chunk's. From there on the two scans agree.
+static void stitchChunk(const uint8_t* data, uint64_t size, chunk* c, uint64_t* resume, group_rows* fixup)
+{
+	const uint64_t* packets = (const uint64_t*)c->packets.data;
+	size_t i = 0;
+
+	while (1)
+	{
+		while (i < c->packets.n && packets[i] < *resume)
+		{
+			i++;
+		}
+
+		uint64_t offset = *resume;
+		uint64_t limit = (i < c->packets.n) ? packets[i] + 1 : c->end;
+		int length = scanPacket(data, size, &offset, limit);
+
+		if (!length)
+		{
+			//nothing left for the sequential scan to meet in this chunk
+			*resume = (*resume > c->end) ? *resume : c->end;
+			return;
+		}
+
+		if (i < c->packets.n && offset == packets[i])
+		{
+			break;
+		}
+
+		clearGroups(fixup);
+		decodeRows(data, offset, 0, fixup);
+		writeRows(fixup, 0, n_packets);
+
+		n_packets++;
+		packet_bytes += length;
+		fixups++;
+		*resume = offset + length;
+	}
+
+	writeRows(c->groups, i, n_packets);
+
+	for (size_t k = i; k < c->packets.n; k++)
+	{
+		uint8_t PT = data[packets[k] + 3];
+		packet_bytes += MIN_PACKET_LENGTH + ((PT & PT_HAS_DATA) ? ((PT & PT_IS_BATCH) ? 4*((PT >> 2) & 0x0F) : 4) : 0);
+	}
+
+	n_packets += c->packets.n - i;
+	*resume = c->stop;
+}
+
+
+int main(int argc, char *argv[])
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int n_threads = (n_cpus < 1) ? 1 : (n_cpus > MAX_THREADS) ? MAX_THREADS : n_cpus;
+	double chunk_mb = DECODE_CHUNK_MB;
+	char* out_dir = ".";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "j:c:o:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'j':
+				n_threads = atoi(optarg);
+				break;
+			case 'c':
+				chunk_mb = atof(optarg);
+				break;
+			case 'o':
+				out_dir = optarg;
+				break;
+			default:
+				help();
+		}
+	}
+
+	if (optind >= argc || n_threads < 1 || n_threads > MAX_THREADS || chunk_mb <= 0)
+	{
+		help();
+	}
+
+	int fd = open(argv[optind], O_RDONLY);
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t size = st.st_size;
+	const uint8_t* data = (size) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+
+	if (size && data == MAP_FAILED)
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+
+	close(fd);
+
+	if (mkdir(out_dir, 0755) != 0 && errno != EEXIST)
+	{
+		perror(out_dir);
+		return EXIT_FAILURE;
+	}
+
+	//every float the NaN bit pattern
+	memset(&blank_state, 0xFF, sizeof(imu_state));
+	openColumns(out_dir);
+
+	//chunks go out in waves a few times the thread count, decoded in any
+	//order and stitched in capture order, so memory stays bounded
+	uint64_t chunk_size = chunk_mb*1024*1024;
+	int wave_size = 4*n_threads;
+	chunk* chunks = calloc(wave_size, sizeof(chunk));
+	group_rows* fixup = calloc(1, sizeof(group_rows)*N_GROUPS);
+	pthread_t threads[MAX_THREADS];
+	uint64_t resume = 0;
+	uint64_t start = hostTime();
+
+	if (!chunks || !fixup)
+	{
+		return EXIT_FAILURE;
+	}
+
+	madvise((void*)data, size, MADV_SEQUENTIAL);
+
+	for (uint64_t wave_start = 0; wave_start < size; wave_start += wave_size*chunk_size)
+	{
+		wave w = {data, size, chunks, 0, 0};
+
+		for (int i = 0; i < wave_size && wave_start + i*chunk_size < size; i++)
+		{
+			chunk* c = &chunks[i];
+
+			c->start = wave_start + i*chunk_size;
+			c->end = (c->start + chunk_size < size) ? c->start + chunk_size : size;
+			c->packets.n = 0;
+			clearGroups(c->groups);
+			w.n_chunks++;
+		}
+
+		for (int t = 0; t < n_threads; t++)
+		{
+			pthread_create(&threads[t], NULL, decode_worker, &w);
+		}
+
+		for (int t = 0; t < n_threads; t++)
+		{
+			pthread_join(threads[t], NULL);
+		}
+
+		for (int i = 0; i < w.n_chunks; i++)
+		{
+			stitchChunk(data, size, &chunks[i], &resume, fixup);
+		}
+	}
+
+	double seconds = (hostTime() - start)*1e-9;
+
+	for (int g = 0; g < N_GROUPS; g++)
+	{
+		for (int f = 0; f < column_groups[g].n_fields + 2; f++)
+		{
+			fclose(columns[g][f]);
+		}
+	}
+
+	//a plain listing of the columns and their lengths for whatever loads them
+	char path[512];
+	snprintf(path, sizeof(path), "%s/columns.txt", out_dir);
+	FILE* listing = fopen(path, "w");
+
+	if (listing)
+	{
+		fprintf(listing, "#group rows fields, each field in <group>.<field>.f32, little-endian\n");
+
+		for (int g = 0; g < N_GROUPS; g++)
+		{
+			fprintf(listing, "%s %llu packet.u64 offset.u64", column_groups[g].name, (unsigned long long)rows[g]);
+
+			for (int f = 0; f < column_groups[g].n_fields; f++)
+			{
+				fprintf(listing, " %s.f32", column_groups[g].fields[f]);
+			}
+
+			fprintf(listing, "\n");
+		}
+
+		fclose(listing);
+	}
+
+	fprintf(stderr, "%llu packets, %llu bytes between them, %llu fixed up at chunk edges. %.3f s on %i threads, %.0f MB/s.\n",
+		(unsigned long long)n_packets, (unsigned long long)(size - packet_bytes), (unsigned long long)fixups, seconds, n_threads, size/seconds/1e6);
+
+	return EXIT_SUCCESS;
+}
+
+
+void help(void)
+{
+	printf("um7rp-decode: decode a raw UART capture (legacy imu.bin) on every core\n");
+	printf("usage: um7rp-decode [-j threads] [-c chunk MB] [-o dir] imu.bin\n");
+	printf(" -j: decoding threads, at most %i (default: every online CPU up to that)\n", MAX_THREADS);
+	printf(" -c: megabytes of capture per chunk (default %i)\n", DECODE_CHUNK_MB);
+	printf(" -o: directory for the columns (default .)\n");
+	printf("\nwrites one file per sample group field, <group>.<field>.f32, with the packet\n");
+	printf("number and byte offset of every row beside it. Registers missing from a\n");
+	printf("packet are NaN. columns.txt lists them.\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "logread.h"
+#include "decode.h"
+#include "align.h"
+#include "clock.h"
+#include "health.h"
+#include "binary.h"
+
+void help(void);
+void print_header(log_reader* reader);
+void print_sample(uint64_t start, const log_record* record, uint32_t updated, imu_state* state);
+void print_event(uint64_t start, const log_record* record, const uint8_t* payload);
+int check_stamps(log_reader* reader);
+
+int main(int argc, char *argv[])
+{
+	double start_seconds = 0;
+	double end_seconds = -1;
+	int is_info = 0;
+	int is_rebuild = 0;
+	int is_check = 0;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "s:e:irch")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				start_seconds = atof(optarg);
+				break;
+			case 'e':
+				end_seconds = atof(optarg);
+				break;
+			case 'i':
+				is_info = 1;
+				break;
+			case 'r':
+				is_rebuild = 1;
+				break;
+			case 'c':
+				is_check = 1;
+				break;
+			default:
+				help();
+		}
+	}
+	
+	if (optind >= argc)
+	{
+		help();
+	}
+	
+	log_reader reader;
+	
+	uint64_t open_start = hostTime();
+	
+	if (!openLogReader(&reader, argv[optind]))
+	{
+		fprintf(stderr, "Could not open capture %s.\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	
+	uint64_t open_time = hostTime() - open_start;
+	
+	if (is_rebuild)
+	{
+		char index_path[256];
+		snprintf(index_path, sizeof(index_path), "%s.idx", argv[optind]);
+		buildLogIndex(&reader, index_path);
+	}
+	
+	if (is_info)
+	{
+		print_header(&reader);
+		printf("opened in:\t%.3f ms\n", open_time*1e-6);
+		closeLogReader(&reader);
+		return EXIT_SUCCESS;
+	}
+	
+	if (is_check)
+	{
+		int is_ok = check_stamps(&reader);
+		closeLogReader(&reader);
+		return (is_ok) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
+	uint64_t t0 = reader.header->start_host + (uint64_t)(start_seconds*1e9);
+	uint64_t t1 = (end_seconds < 0) ? UINT64_MAX : reader.header->start_host + (uint64_t)(end_seconds*1e9);
+	
+	log_cursor cursor;
+	imu_state state;
+	clock_align align;
+	
+	memset(&state, 0, sizeof(imu_state));
+	initClockAlign(&align);
+	seekLog(&reader, t0, &cursor);
+	
+	while (nextLogRecord(&reader, &cursor) && cursor.record->timestamp <= t1)
+	{
+		if (cursor.record->kind == LOG_EVENT)
+		{
+			print_event(reader.header->start_host, cursor.record, cursor.payload);
+			continue;
+		}
+		
+		if (cursor.record->kind != LOG_PACKET)
+		{
+			continue;
+		}
+		
+		uint32_t updated = 0;
+		
+		if (cursor.record->packet_type & PT_HAS_DATA)
+		{
+			updated = decodeRegisters(cursor.record->address, cursor.payload, cursor.record->length/4, &state);
+			stampSamples(&align, &state, updated, cursor.record->timestamp);
+		}
+		
+		print_sample(reader.header->start_host, cursor.record, updated, &state);
+	}
+	
+	if (align.is_locked)
+	{
+		fprintf(stderr, "UM7 clock: offset %.6f s, drift %.2f ppm, USB jitter %.3f ms, %u resets.\n", align.offset, align.drift*1e6, align.jitter*1e3, align.resets);
+	}
+	
+	if (reader.corrupt_regions)
+	{
+		fprintf(stderr, "Skipped %u corrupted regions.\n", reader.corrupt_regions);
+	}
+	
+	closeLogReader(&reader);
+	
+	return EXIT_SUCCESS;
+}
+
+
+void print_header(log_reader* reader)
+{
+	const log_header* header = reader->header;
+	time_t start = header->start_wall/1000000000ULL;
+	
+	printf("version:\t%i\n", header->version);
+	printf("started:\t%s", ctime(&start));
+	printf("firmware:\t%.4s\n", header->firmware);
+	printf("size:\t\t%llu bytes\n", (unsigned long long)reader->size);
+	if (reader->block)
+	{
+		printf("index:\t\t%u entries, one per packed block\n", reader->index_entries);
+	}
+	else
+	{
+		printf("index:\t\t%u entries every %u packets\n", reader->index_entries, header->sync_interval);
+	}
+	
+	if (reader->index_entries)
+	{
+		printf("duration:\t%.3f s\n", (reader->index[reader->index_entries - 1].timestamp - header->start_host)*1e-9);
+	}
+	
+	for (int i = 0; i < LOG_CONFIG_REGISTERS; i++)
+	{
+		printf("UM7_R%i:\t\t%i %i %i %i\n", CREG_COM_SETTINGS + i, header->config[i][0], header->config[i][1], header->config[i][2], header->config[i][3]);
+	}
+}
+
+
+//seconds of a host stamp from the start of the capture, aligned stamps are 
+//0 until the clock fit has locked and print as -1
+static double since(uint64_t start, uint64_t stamp)
+{
+	return (stamp) ? (int64_t)(stamp - start)*1e-9 : -1;
+}
+
+
+//each sample group prints its values, the UM7 time register and that time
+//aligned to the host clock, all times in seconds
+void print_sample(uint64_t start, const log_record* record, uint32_t updated, imu_state* state)
+{
+	printf("%.6f %u 0x%02X", since(start, record->timestamp), record->sequence, record->address);
+	
+	if (updated & DECODED_HEALTH)
+		printf(" health %i/%i %i %i", state->health.sats_used, state->health.sats_view, state->health.gps_fail, state->health.uart_fail);
+	if (updated & DECODED_TEMPERATURE)
+		printf(" temperature %f %f %.6f", state->temperature, state->temperature_time, since(start, state->temperature_stamp.aligned));
+	if (updated & DECODED_GYRO)
+		printf(" gyro %f %f %f %f %.6f", state->gyro.x, state->gyro.y, state->gyro.z, state->gyro.time, since(start, state->gyro.stamp.aligned));
+	if (updated & DECODED_ACCEL)
+		printf(" accel %f %f %f %f %.6f", state->accel.x, state->accel.y, state->accel.z, state->accel.time, since(start, state->accel.stamp.aligned));
+	if (updated & DECODED_MAG)
+		printf(" mag %f %f %f %f %.6f", state->mag.x, state->mag.y, state->mag.z, state->mag.time, since(start, state->mag.stamp.aligned));
+	if (updated & DECODED_QUAT)
+		printf(" quat %f %f %f %f %f %.6f", state->quat.a, state->quat.b, state->quat.c, state->quat.d, state->quat.time, since(start, state->quat.stamp.aligned));
+	if (updated & DECODED_EULER)
+		printf(" euler %f %f %f %f %.6f", state->euler.roll, state->euler.pitch, state->euler.yaw, state->euler.time, since(start, state->euler.stamp.aligned));
+	if (updated & DECODED_POSITION)
+		printf(" position %f %f %f %f %.6f", state->position.x, state->position.y, state->position.z, state->position.time, since(start, state->position.stamp.aligned));
+	if (updated & DECODED_VELOCITY)
+		printf(" velocity %f %f %f %f %.6f", state->velocity.x, state->velocity.y, state->velocity.z, state->velocity.time, since(start, state->velocity.stamp.aligned));
+	if (updated & DECODED_GPS)
+		printf(" gps %f %f %f %f %.6f", state->gps.latitude, state->gps.longitude, state->gps.altitude, state->gps.time, since(start, state->gps.stamp.aligned));
+	
+	printf("\n");
+}
+
+
+void print_event(uint64_t start, const log_record* record, const uint8_t* payload)
+{
+	uint8_t data[4];
+	uint32_t changed;
+	heartbeat beat;
+	
+	if (record->address != DREG_HEALTH || record->length != 8)
+	{
+		return;
+	}
+	
+	memcpy(data, payload, 4);
+	memcpy(&changed, &payload[4], sizeof(uint32_t));
+	decodeHealth(bit8ArrayToBit32(data), &beat);
+	
+	printf("%.6f %u 0x%02X event", since(start, record->timestamp), record->sequence, record->address);
+	printHealthChanges(stdout, healthFlags(&beat), changed);
+	printf(" sats %i/%i\n", beat.sats_used, beat.sats_view);
+}
+
+
+//seeks and the resampler rely on record stamps that never go back
+int check_stamps(log_reader* reader)
+{
+	log_cursor cursor;
+	uint64_t last = 0, records = 0, backwards = 0;
+	
+	seekLog(reader, 0, &cursor);
+	
+	while (nextLogRecord(reader, &cursor))
+	{
+		if (cursor.record->timestamp < last)
+		{
+			printf("record %llu (sequence %u) is %.6f s before the one ahead of it\n", (unsigned long long)records, cursor.record->sequence, 
+				(last - cursor.record->timestamp)*1e-9);
+			backwards++;
+		}
+		
+		last = (cursor.record->timestamp > last) ? cursor.record->timestamp : last;
+		records++;
+	}
+	
+	printf("%llu records, %llu stamps went back, %u corrupted regions.\n", (unsigned long long)records, (unsigned long long)backwards, reader->corrupt_regions);
+	
+	return backwards == 0;
+}
+
+
+void help(void)
+{
+	printf("um7rp-log: print the samples in a capture\n");
+	printf("usage: um7rp-log [-s start] [-e end] [-i] [-r] [-c] imu.log\n");
+	printf(" -s: first sample to print, seconds from the start of the capture\n");
+	printf(" -e: last sample to print, seconds from the start of the capture\n");
+	printf(" -i: print the header and index summary only\n");
+	printf(" -r: rebuild the time index\n");
+	printf(" -c: check that record stamps never go back, exits 1 if one does\n");
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "logread.h"
+#include "decode.h"
+#include "align.h"
+#include "clock.h"
+#include "shmring.h"
+#include "strapdown.h"
+
+void help(void);
+int nav_log(const char* path);
+int nav_live(int device);
+void write_pose(const strapdown_pose* pose);
+void print_summary(uint64_t poses, uint64_t busy);
+
+int is_binary = 0;
+int is_quiet = 0;
+strapdown imu_nav;
+
+int main(int argc, char *argv[])
+{
+	double lever_arm[3] = {0, 0, 0};
+	int is_live = 0;
+	int device = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:fd:bqh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a':
+				if (sscanf(optarg, "%lf,%lf,%lf", &lever_arm[0], &lever_arm[1], &lever_arm[2]) != 3)
+				{
+					help();
+				}
+				break;
+			case 'f':
+				is_live = 1;
+				break;
+			case 'd':
+				device = atoi(optarg);
+				break;
+			case 'b':
+				is_binary = 1;
+				break;
+			case 'q':
+				is_quiet = 1;
+				break;
+			default:
+				help();
+		}
+	}
+
+	initStrapdown(&imu_nav, lever_arm);
+
+	if (is_live)
+	{
+		return nav_live(device);
+	}
+
+	if (optind >= argc)
+	{
+		help();
+	}
+
+	return nav_log(argv[optind]);
+}
+
+
+void write_pose(const strapdown_pose* pose)
+{
+	if (is_quiet)
+	{
+		return;
+	}
+
+	if (is_binary)
+	{
+		fwrite(pose, sizeof(strapdown_pose), 1, stdout);
+		return;
+	}
+
+	printf("%.9f quat %f %f %f %f position %.4f %.4f %.4f velocity %.4f %.4f %.4f\n", pose->time*1e-9, pose->quat[0], pose->quat[1], pose->quat[2], pose->quat[3],
+		pose->position[0], pose->position[1], pose->position[2], pose->velocity[0], pose->velocity[1], pose->velocity[2]);
+}
+
+
+void print_summary(uint64_t poses, uint64_t busy)
+{
+	fprintf(stderr, "%llu poses, %u restarts, %.0f ns per pose. Gyro bias %.4f %.4f %.4f deg/s.\n", (unsigned long long)poses, imu_nav.restarts,
+		(poses) ? (double)busy/poses : 0, imu_nav.gyro_bias[0]*180/M_PI, imu_nav.gyro_bias[1]*180/M_PI, imu_nav.gyro_bias[2]*180/M_PI);
+}
+
+
+//replays a capture through the integrator as fast as it decodes
+int nav_log(const char* path)
+{
+	log_reader reader;
+
+	if (!openLogReader(&reader, path))
+	{
+		fprintf(stderr, "Could not open capture %s.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	log_cursor cursor;
+	imu_state state;
+	clock_align align;
+	strapdown_pose pose;
+	uint64_t poses = 0, busy = 0;
+
+	memset(&state, 0, sizeof(imu_state));
+	initClockAlign(&align);
+	seekLog(&reader, 0, &cursor);
+
+	while (nextLogRecord(&reader, &cursor))
+	{
+		if (cursor.record->kind != LOG_PACKET || !(cursor.record->packet_type & PT_HAS_DATA))
+		{
+			continue;
+		}
+
+		uint32_t updated = decodeRegisters(cursor.record->address, cursor.payload, cursor.record->length/4, &state);
+		stampSamples(&align, &state, updated, cursor.record->timestamp);
+
+		uint64_t start = hostTime();
+		int is_pose = updateStrapdown(&imu_nav, &state, updated, &pose);
+		busy += hostTime() - start;
+
+		if (is_pose)
+		{
+			write_pose(&pose);
+			poses++;
+		}
+	}
+
+	fflush(stdout);
+	print_summary(poses, busy);
+	closeLogReader(&reader);
+
+	return EXIT_SUCCESS;
+}
+
+
+//follows a running um7rp through its sample ring, a pose per accel sample
+//as it arrives
+int nav_live(int device)
+{
+	sample_ring* ring = openRing();
+
+	if (!ring)
+	{
+		fprintf(stderr, "No running um7rp found (%s).\n", SHMRING_NAME);
+		return EXIT_FAILURE;
+	}
+
+	ring_reader reader;
+	ring_sample sample;
+	strapdown_pose pose;
+	uint64_t poses = 0, busy = 0;
+
+	initRingReader(&reader, ring, 0);
+
+	while (1)
+	{
+		if (!waitSample(&reader, &sample, 1000))
+		{
+			if (kill(ring->pid, 0) != 0)
+			{
+				fprintf(stderr, "um7rp (pid %i) has exited.\n", ring->pid);
+				break;
+			}
+
+			continue;
+		}
+
+		if (sample.device != device)
+		{
+			continue;
+		}
+
+		uint64_t start = hostTime();
+		int is_pose = updateStrapdown(&imu_nav, &sample.state, sample.updated, &pose);
+		busy += hostTime() - start;
+
+		if (is_pose)
+		{
+			write_pose(&pose);
+			fflush(stdout);
+			poses++;
+		}
+	}
+
+	print_summary(poses, busy);
+	fprintf(stderr, "%llu samples lost.\n", (unsigned long long)reader.lost);
+	closeRing(ring);
+
+	return EXIT_SUCCESS;
+}
+
+
+void help(void)
+{
+	printf("um7rp-nav: strapdown integration of processed gyro and accel\n");
+	printf("usage: um7rp-nav [-a x,y,z] [-b] [-q] imu.log\n");
+	printf("       um7rp-nav [-a x,y,z] [-b] [-q] [-d device] -f\n");
+	printf(" -a: lever arm from the UM7 to the antenna phase centre, body frame metres\n");
+	printf(" -f: follow a running um7rp instead of reading a capture\n");
+	printf(" -d: device to follow (default 0)\n");
+	printf(" -b: write strapdown_pose records instead of text\n");
+	printf(" -q: no poses, only the summary\n");
+	printf("\nposes come at the accel rate in the north-east-down frame of the first\n");
+	printf("GPS fix. The device quaternion and GPS correct the integration slowly.\n");
+	printf("\nwith -f the sample ring %s must be writable by this user, a um7rp\n", SHMRING_NAME);
+	printf("running as root sets its permissions with -A (default %04o).\n", SHMRING_MODE);
+	exit(EXIT_SUCCESS);
+}
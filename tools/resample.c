@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "logread.h"
+#include "decode.h"
+#include "align.h"
+#include "clock.h"
+#include "shmring.h"
+#include "resample.h"
+
+#define PENDING_TRIGGERS	4096	//online triggers waiting for samples past them
+
+void help(void);
+int resample_log(const char* path, uint64_t* times, long n_times, double period_ms);
+int resample_live(const char* trigger_path, int device);
+long load_triggers(const char* path, uint64_t** times);
+int resolve(resampler* r, const uint64_t* times, int n, int is_forced);
+void print_state(const resampled_state* state);
+
+int is_binary = 0;
+int mode = RESAMPLE_LINEAR;
+resampler imu_resampler;
+resampled_state resampled[RESAMPLE_BATCH];
+uint64_t n_resampled = 0;
+
+int main(int argc, char *argv[])
+{
+	char* trigger_path = NULL;
+	char* fifo_path = NULL;
+	double period_ms = 0;
+	int device = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:p:f:d:cbh")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				trigger_path = optarg;
+				break;
+			case 'p':
+				period_ms = atof(optarg);
+				break;
+			case 'f':
+				fifo_path = optarg;
+				break;
+			case 'd':
+				device = atoi(optarg);
+				break;
+			case 'c':
+				mode = RESAMPLE_CUBIC;
+				break;
+			case 'b':
+				is_binary = 1;
+				break;
+			default:
+				help();
+		}
+	}
+
+	initResampler(&imu_resampler, mode);
+
+	if (fifo_path)
+	{
+		return resample_live(fifo_path, device);
+	}
+
+	if (optind >= argc || (!trigger_path && period_ms <= 0))
+	{
+		help();
+	}
+
+	uint64_t* times = NULL;
+	long n_times = 0;
+
+	if (trigger_path && (n_times = load_triggers(trigger_path, &times)) < 0)
+	{
+		fprintf(stderr, "Could not read triggers from %s.\n", trigger_path);
+		return EXIT_FAILURE;
+	}
+
+	return resample_log(argv[optind], times, n_times, period_ms);
+}
+
+
+//interpolates the triggers that samples have passed, or all of them when
+//'is_forced'. Returns how many were taken from the front of 'times'.
+int resolve(resampler* r, const uint64_t* times, int n, int is_forced)
+{
+	int ready = 0;
+
+	while (ready < n && ready < RESAMPLE_BATCH && (is_forced || isResampleReady(r, times[ready])))
+	{
+		ready++;
+	}
+
+	if (ready == 0)
+	{
+		return 0;
+	}
+
+	resample(r, times, ready, resampled);
+
+	if (is_binary)
+	{
+		fwrite(resampled, sizeof(resampled_state), ready, stdout);
+	}
+	else
+	{
+		for (int i = 0; i < ready; i++)
+		{
+			print_state(&resampled[i]);
+		}
+	}
+
+	n_resampled += ready;
+
+	return ready;
+}
+
+
+static int compare_times(const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+
+//one trigger per line, host clock nanoseconds as um7rp stamps them
+long load_triggers(const char* path, uint64_t** times)
+{
+	FILE* file = fopen(path, "r");
+	long n = 0, size = 4096;
+	unsigned long long t;
+
+	if (!file)
+	{
+		return -1;
+	}
+
+	*times = malloc(size*sizeof(uint64_t));
+
+	while (*times && fscanf(file, "%llu", &t) == 1)
+	{
+		if (n == size)
+		{
+			size *= 2;
+			*times = realloc(*times, size*sizeof(uint64_t));
+
+			if (!*times)
+			{
+				break;
+			}
+		}
+
+		(*times)[n++] = t;
+	}
+
+	fclose(file);
+
+	if (!*times)
+	{
+		return -1;
+	}
+
+	qsort(*times, n, sizeof(uint64_t), compare_times);
+
+	return n;
+}
+
+
+//replays a capture through the same stage as a live run, so the history
+//window bounds memory however long the capture is. Without a trigger file
+//triggers are made every 'period_ms' from the start of the capture.
+int resample_log(const char* path, uint64_t* times, long n_times, double period_ms)
+{
+	log_reader reader;
+
+	if (!openLogReader(&reader, path))
+	{
+		fprintf(stderr, "Could not open capture %s.\n", path);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t start = hostTime();
+	uint64_t period = period_ms*1e6;
+	uint64_t next_time = reader.header->start_host;
+	uint64_t generated[RESAMPLE_BATCH];
+	long next = 0;
+
+	log_cursor cursor;
+	imu_state state;
+	clock_align align;
+
+	memset(&state, 0, sizeof(imu_state));
+	initClockAlign(&align);
+	seekLog(&reader, 0, &cursor);
+
+	while (nextLogRecord(&reader, &cursor))
+	{
+		if (cursor.record->kind != LOG_PACKET || !(cursor.record->packet_type & PT_HAS_DATA))
+		{
+			continue;
+		}
+
+		uint32_t updated = decodeRegisters(cursor.record->address, cursor.payload, cursor.record->length/4, &state);
+		stampSamples(&align, &state, updated, cursor.record->timestamp);
+		addResampleSamples(&imu_resampler, &state, updated);
+
+		if (times)
+		{
+			next += resolve(&imu_resampler, &times[next], n_times - next, 0);
+			continue;
+		}
+
+		//periodic triggers are made a batch at a time as the capture passes them
+		while (isResampleReady(&imu_resampler, next_time))
+		{
+			for (int i = 0; i < RESAMPLE_BATCH; i++)
+			{
+				generated[i] = next_time + i*period;
+			}
+
+			int n = resolve(&imu_resampler, generated, RESAMPLE_BATCH, 0);
+			next_time += n*period;
+		}
+	}
+
+	//what the capture never passed is given with the groups it did cover
+	while (times && next < n_times)
+	{
+		next += resolve(&imu_resampler, &times[next], n_times - next, 1);
+	}
+
+	fflush(stdout);
+	fprintf(stderr, "%llu triggers resampled in %.3f s.\n", (unsigned long long)n_resampled, (hostTime() - start)*1e-9);
+
+	free(times);
+	closeLogReader(&reader);
+
+	return EXIT_SUCCESS;
+}
+
+
+//follows a running um7rp through its sample ring. Triggers arrive as native
+//uint64 host clock times on a pipe, FIFO or stdin ('-'), and each is
+//answered as soon as samples past it are in, or after a stale gap.
+int resample_live(const char* trigger_path, int device)
+{
+	sample_ring* ring = openRing();
+
+	if (!ring)
+	{
+		fprintf(stderr, "No running um7rp found (%s).\n", SHMRING_NAME);
+		return EXIT_FAILURE;
+	}
+
+	//a FIFO opened for writing too never reports end of file between writers
+	int is_stdin = (strcmp(trigger_path, "-") == 0);
+	int fd = is_stdin ? STDIN_FILENO : open(trigger_path, O_RDWR | O_NONBLOCK);
+
+	if (fd < 0)
+	{
+		perror(trigger_path);
+		return EXIT_FAILURE;
+	}
+
+	ring_reader reader;
+	ring_sample sample;
+	uint64_t pending[PENDING_TRIGGERS];
+	uint8_t partial[sizeof(uint64_t)];
+	int n_partial = 0;
+	int n_pending = 0;
+	int is_open = 1;
+	uint64_t dropped = 0;
+
+	initRingReader(&reader, ring, 0);
+	signal(SIGPIPE, SIG_IGN);
+
+	while (is_open || n_pending)
+	{
+		struct pollfd p = {fd, POLLIN, 0};
+
+		if (is_open && poll(&p, 1, 1) > 0)
+		{
+			uint8_t buffer[4096];
+			ssize_t n = read(fd, buffer, sizeof(buffer));
+
+			if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+			{
+				is_open = 0;
+			}
+
+			//times may be split across reads
+			for (ssize_t i = 0; i < n; i++)
+			{
+				partial[n_partial++] = buffer[i];
+
+				if (n_partial < sizeof(uint64_t))
+				{
+					continue;
+				}
+
+				if (n_pending == PENDING_TRIGGERS)
+				{
+					memmove(pending, &pending[1], (PENDING_TRIGGERS - 1)*sizeof(uint64_t));
+					n_pending--;
+					dropped++;
+				}
+
+				memcpy(&pending[n_pending++], partial, sizeof(uint64_t));
+				n_partial = 0;
+			}
+		}
+		else if (!is_open)
+		{
+			usleep(1000);
+		}
+
+		while (readSample(&reader, &sample))
+		{
+			if (sample.device == device)
+			{
+				addResampleSamples(&imu_resampler, &sample.state, sample.updated);
+			}
+		}
+
+		int done = 0;
+
+		while (done < n_pending)
+		{
+			int is_forced = (hostTime() > pending[done] + RESAMPLE_STALE_NS);
+			int n = resolve(&imu_resampler, &pending[done], (is_forced) ? 1 : n_pending - done, is_forced);
+
+			if (n == 0)
+			{
+				break;
+			}
+
+			done += n;
+		}
+
+		if (done)
+		{
+			memmove(pending, &pending[done], (n_pending - done)*sizeof(uint64_t));
+			n_pending -= done;
+			fflush(stdout);
+		}
+
+		if (kill(ring->pid, 0) != 0)
+		{
+			fprintf(stderr, "um7rp (pid %i) has exited.\n", ring->pid);
+			break;
+		}
+	}
+
+	fprintf(stderr, "%llu triggers resampled, %llu dropped, %llu samples lost.\n", (unsigned long long)n_resampled,
+		(unsigned long long)dropped, (unsigned long long)reader.lost);
+	closeRing(ring);
+
+	return EXIT_SUCCESS;
+}
+
+
+//host time in seconds, then each group, invalid groups print as zeros
+void print_state(const resampled_state* state)
+{
+	printf("%.9f 0x%03X quat %f %f %f %f rates %f %f %f gyro %f %f %f position %f %f %f velocity %f %f %f\n", state->time*1e-9, state->valid,
+		state->quat[0], state->quat[1], state->quat[2], state->quat[3], state->rates[0], state->rates[1], state->rates[2],
+		state->gyro[0], state->gyro[1], state->gyro[2], state->position[0], state->position[1], state->position[2],
+		state->velocity[0], state->velocity[1], state->velocity[2]);
+}
+
+
+void help(void)
+{
+	printf("um7rp-resample: interpolate the IMU state at trigger times\n");
+	printf("usage: um7rp-resample [-c] [-b] (-t triggers | -p period) imu.log\n");
+	printf("       um7rp-resample [-c] [-b] [-d device] -f fifo\n");
+	printf(" -t: text file of trigger times, host clock nanoseconds, one per line\n");
+	printf(" -p: a trigger every 'period' milliseconds from the start of the capture\n");
+	printf(" -f: follow a running um7rp, triggers are native uint64 host clock times\n");
+	printf("     written to this FIFO, or to stdin for '-'\n");
+	printf(" -d: device to follow (default 0)\n");
+	printf(" -c: cubic interpolation of rates, position and velocity (default linear)\n");
+	printf(" -b: write resampled_state records instead of text\n");
+	printf("\nquaternions are slerped. Groups without samples either side of a trigger\n");
+	printf("are left out of its valid mask.\n");
+	printf("\nwith -f the sample ring %s must be writable by this user, a um7rp\n", SHMRING_NAME);
+	printf("running as root sets its permissions with -A (default %04o).\n", SHMRING_MODE);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,657 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <math.h>
+
+#include "um7.h"
+#include "parser.h"
+#include "clock.h"
+#include "colour.h"
+
+#define SIM_FW_REVISION		"U7AE"
+#define SIM_MAX_GROUPS		11
+
+//a broadcast packet: 'count' consecutive registers starting at 'address'
+typedef struct
+{
+  const char* name;
+  uint8_t address;
+  uint8_t count;
+  double rate;					//packets per second, 0 = off
+  int is_fixed;					//rate set on the command line, ignore CREG_COM_RATES
+  uint64_t next_due;
+} broadcast_group;
+
+typedef struct
+{
+  uint64_t packets_sent;
+  uint64_t bytes_sent;
+  uint64_t requests;
+  uint64_t overflows;
+  uint64_t bit_errors;
+  uint64_t dropped_bytes;
+  uint64_t bad_checksums;
+} sim_stats;
+
+void help(void);
+void parse_options(int argc, char *argv[]);
+int open_pty(void);
+void update_registers(double t);
+void update_rates(void);
+void factory_defaults(void);
+void handle_request(const packet* request);
+void send_packet(uint8_t packet_type, uint8_t address, uint8_t count);
+void print_stats(void);
+void link_flush(void);
+void stop(int signal);
+
+broadcast_group groups[SIM_MAX_GROUPS] =
+{
+	{"health", 		DREG_HEALTH, 		1, 	0, 0, 0},
+	{"temperature", DREG_TEMPERATURE, 	2, 	0, 0, 0},
+	{"all_proc", 	DREG_ALL_PROC, 		12, 0, 0, 0},
+	{"gyro", 		DREG_GYRO_PROC_X, 	4, 	0, 0, 0},
+	{"accel", 		DREG_ACCEL_PROC_X, 	4, 	0, 0, 0},
+	{"mag", 		DREG_MAG_PROC_X, 	4, 	0, 0, 0},
+	{"quat", 		DREG_QUAT_AB, 		3, 	0, 0, 0},
+	{"euler", 		DREG_EULER_PHI_THETA, 5, 0, 0, 0},
+	{"position", 	DREG_POSITION_N, 	4, 	0, 0, 0},
+	{"velocity", 	DREG_VELOCITY_N, 	4, 	0, 0, 0},
+	{"gps", 		DREG_GPS_LATITUDE, 	6, 	0, 0, 0},
+};
+
+uint8_t registers[256][4];
+sim_stats stats;
+parser request_parser;
+
+int master_fd = -1;
+int slave_fd = -1;
+char* link_path = NULL;
+int baud_rate = 0;				//0 = as fast as the pty accepts
+double bit_error_rate = 0;
+double drop_rate = 0;
+double bad_checksum_rate = 0;
+int is_verbose = 0;
+double clock_drift = 0;			//device clock error in ppm
+int latency_ms = 0;				//USB adapter latency timer, 0 = bytes go out at once
+double gps_outage = 0;			//seconds of GPS lock then seconds without, 0 = always locked
+uint8_t link_buffer[65536];
+int link_pending = 0;
+volatile int is_running = 1;
+int uart_overflow = 0;
+
+int main(int argc, char *argv[])
+{
+	parse_options(argc, argv);
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	if (open_pty() < 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	memset(registers, 0, sizeof(registers));
+	factory_defaults();
+	initParser(&request_parser);
+
+	uint64_t start = hostTime();
+	uint64_t last_report = start;
+	uint64_t next_flush = start;
+
+	for (int i = 0; i < SIM_MAX_GROUPS; i++)
+	{
+		groups[i].next_due = start;
+	}
+
+	while (is_running)
+	{
+		uint64_t now = hostTime();
+		uint64_t next_due = now + 100000000ULL;
+
+		//emit everything that is due, catching up if the loop fell behind
+		for (int i = 0; i < SIM_MAX_GROUPS; i++)
+		{
+			if (groups[i].rate <= 0)
+			{
+				continue;
+			}
+
+			uint64_t period = (uint64_t)(1e9/groups[i].rate);
+
+			while (groups[i].next_due <= now)
+			{
+				update_registers((groups[i].next_due - start)*1e-9*(1 + clock_drift*1e-6));
+				send_packet(PT_HAS_DATA | ((groups[i].count > 1) ? PT_IS_BATCH | (groups[i].count << 2) : 0), groups[i].address, groups[i].count);
+				groups[i].next_due += period;
+			}
+
+			if (groups[i].next_due < next_due)
+			{
+				next_due = groups[i].next_due;
+			}
+		}
+
+		if (latency_ms > 0)
+		{
+			if (now >= next_flush)
+			{
+				link_flush();
+				next_flush += latency_ms*1000000ULL;
+			}
+
+			if (next_flush < next_due)
+			{
+				next_due = next_flush;
+			}
+		}
+
+		int timeout_ms = (next_due > now) ? (next_due - now)/1000000ULL : 0;
+		struct pollfd request_poll = {master_fd, POLLIN, 0};
+
+		if (poll(&request_poll, 1, timeout_ms) > 0 && (request_poll.revents & POLLIN))
+		{
+			uint8_t buffer[512];
+			int n = read(master_fd, buffer, sizeof(buffer));
+
+			if (n > 0)
+			{
+				packet request;
+				parserPush(&request_parser, buffer, n);
+
+				while (parserNext(&request_parser, &request))
+				{
+					handle_request(&request);
+				}
+			}
+		}
+
+		if (is_verbose && now - last_report > 1000000000ULL)
+		{
+			print_stats();
+			last_report = now;
+		}
+	}
+
+	print_stats();
+
+	if (link_path)
+	{
+		unlink(link_path);
+	}
+
+	close(slave_fd);
+	close(master_fd);
+
+	return EXIT_SUCCESS;
+}
+
+
+int open_pty(void)
+{
+	if ((master_fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0 || grantpt(master_fd) || unlockpt(master_fd))
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open a pseudo-terminal.\n");
+		return -1;
+	}
+
+	char* slave_path = ptsname(master_fd);
+
+	//hold the slave open so the master never sees a hang-up between clients,
+	//and make it raw so the line discipline does not echo or translate bytes
+	if ((slave_fd = open(slave_path, O_RDWR | O_NOCTTY)) < 0)
+	{
+		cprint("[!!] ", BRIGHT, RED);
+		printf("Could not open %s.\n", slave_path);
+		return -1;
+	}
+
+	struct termios tty;
+	tcgetattr(slave_fd, &tty);
+	cfmakeraw(&tty);
+	tcsetattr(slave_fd, TCSANOW, &tty);
+
+	fcntl(master_fd, F_SETFL, fcntl(master_fd, F_GETFL) | O_NONBLOCK);
+
+	cprint("[OK] ", BRIGHT, GREEN);
+	printf("Simulated UM7 on %s.\n", slave_path);
+
+	if (link_path)
+	{
+		unlink(link_path);
+
+		if (symlink(slave_path, link_path) == 0)
+		{
+			cprint("[OK] ", BRIGHT, GREEN);
+			printf("Linked %s.\n", link_path);
+		}
+	}
+
+	fflush(stdout);
+
+	return 0;
+}
+
+
+static void putFloat(uint8_t address, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+
+	registers[address][0] = bits >> 24;
+	registers[address][1] = bits >> 16;
+	registers[address][2] = bits >> 8;
+	registers[address][3] = bits;
+}
+
+
+static void putInt16Pair(uint8_t address, float high, float low, float scale)
+{
+	int16_t a = (int16_t)lrintf(high*scale);
+	int16_t b = (int16_t)lrintf(low*scale);
+
+	registers[address][0] = (uint16_t)a >> 8;
+	registers[address][1] = (uint16_t)a;
+	registers[address][2] = (uint16_t)b >> 8;
+	registers[address][3] = (uint16_t)b;
+}
+
+
+//synthetic motion: a slow yaw rotation with some roll and pitch sway
+void update_registers(double t)
+{
+	float roll = 10*sin(2*M_PI*0.2*t);
+	float pitch = 5*sin(2*M_PI*0.1*t);
+	float yaw = fmod(20*t, 360) - 180;
+
+	putFloat(DREG_GYRO_PROC_X, 10*2*M_PI*0.2*cos(2*M_PI*0.2*t));
+	putFloat(DREG_GYRO_PROC_Y, 5*2*M_PI*0.1*cos(2*M_PI*0.1*t));
+	putFloat(DREG_GYRO_PROC_Z, 20);
+	putFloat(DREG_GYRO_PROC_TIME, t);
+
+	putFloat(DREG_ACCEL_PROC_X, sin(pitch*M_PI/180));
+	putFloat(DREG_ACCEL_PROC_Y, -sin(roll*M_PI/180));
+	putFloat(DREG_ACCEL_PROC_Z, -cos(roll*M_PI/180)*cos(pitch*M_PI/180));
+	putFloat(DREG_ACCEL_PROC_TIME, t);
+
+	putFloat(DREG_MAG_PROC_X, cos(yaw*M_PI/180));
+	putFloat(DREG_MAG_PROC_Y, -sin(yaw*M_PI/180));
+	putFloat(DREG_MAG_PROC_Z, 0.5);
+	putFloat(DREG_MAG_PROC_TIME, t);
+
+	putInt16Pair(DREG_QUAT_AB, cos(yaw*M_PI/360), 0, 29789.09f);
+	putInt16Pair(DREG_QUAT_CD, 0, sin(yaw*M_PI/360), 29789.09f);
+	putFloat(DREG_QUAT_TIME, t);
+
+	putInt16Pair(DREG_EULER_PHI_THETA, roll, pitch, 91.02222f);
+	putInt16Pair(DREG_EULER_PSI, yaw, 0, 91.02222f);
+	putInt16Pair(DREG_EULER_PHI_THETA_DOT, 10*2*M_PI*0.2*cos(2*M_PI*0.2*t), 5*2*M_PI*0.1*cos(2*M_PI*0.1*t), 16.0f);
+	putInt16Pair(DREG_EULER_PSI_DOT, 20, 0, 16.0f);
+	putFloat(DREG_EULER_TIME, t);
+
+	putFloat(DREG_POSITION_N, 50*sin(2*M_PI*0.01*t));
+	putFloat(DREG_POSITION_E, 50*cos(2*M_PI*0.01*t));
+	putFloat(DREG_POSITION_UP, 10);
+	putFloat(DREG_POSITION_TIME, t);
+
+	putFloat(DREG_VELOCITY_N, 50*2*M_PI*0.01*cos(2*M_PI*0.01*t));
+	putFloat(DREG_VELOCITY_E, -50*2*M_PI*0.01*sin(2*M_PI*0.01*t));
+	putFloat(DREG_VELOCITY_UP, 0);
+	putFloat(DREG_VELOCITY_TIME, t);
+
+	putFloat(DREG_GPS_LATITUDE, -33.9575);
+	putFloat(DREG_GPS_LONGITUDE, 18.4611);
+	putFloat(DREG_GPS_ALTITUDE, 25);
+	putFloat(DREG_GPS_COURSE, yaw);
+	putFloat(DREG_GPS_SPEED, 3.14);
+	putFloat(DREG_GPS_TIME, t);
+
+	putFloat(DREG_TEMPERATURE, 35 + sin(t*0.01));
+	putFloat(DREG_TEMPERATURE_TIME, t);
+
+	//8 satellites used, 11 in view, hdop 1.2, uart overflow since last report
+	uint32_t health = (8u << 26) | (12u << 16) | (11u << 10) | (uart_overflow ? (1u << 8) : 0);
+	
+	if (gps_outage > 0 && ((long)(t/gps_outage)) % 2)
+	{
+		//no satellites used and the GPS fault bit set
+		health = (health & ~(0x3Fu << 26)) | 1u;
+	}
+
+	registers[DREG_HEALTH][0] = health >> 24;
+	registers[DREG_HEALTH][1] = health >> 16;
+	registers[DREG_HEALTH][2] = health >> 8;
+	registers[DREG_HEALTH][3] = health;
+}
+
+
+void factory_defaults(void)
+{
+	memset(registers, 0, CREG_HOME_NORTH*4);
+	
+	registers[CREG_COM_SETTINGS][0] = (5 << 4) + 4;	//115200 main port, 57600 gps
+	registers[CREG_COM_RATES6][1] = 4;					//1 Hz health
+	
+	update_rates();
+}
+
+
+//broadcast rates follow CREG_COM_RATES unless fixed on the command line
+void update_rates(void)
+{
+	static const double health_rates[8] = {0, 0.125, 0.25, 0.5, 1, 2, 4, 0};
+
+	double rates[SIM_MAX_GROUPS] =
+	{
+		health_rates[registers[CREG_COM_RATES6][1] & 0x07],
+		registers[CREG_COM_RATES2][0],
+		registers[CREG_COM_RATES4][3],
+		registers[CREG_COM_RATES3][1],
+		registers[CREG_COM_RATES3][0],
+		registers[CREG_COM_RATES3][2],
+		registers[CREG_COM_RATES5][0],
+		registers[CREG_COM_RATES5][1],
+		registers[CREG_COM_RATES5][2],
+		registers[CREG_COM_RATES5][3],
+		0,
+	};
+
+	uint64_t now = hostTime();
+
+	for (int i = 0; i < SIM_MAX_GROUPS; i++)
+	{
+		if (!groups[i].is_fixed && groups[i].rate != rates[i])
+		{
+			groups[i].rate = rates[i];
+			groups[i].next_due = now;
+		}
+	}
+}
+
+
+void handle_request(const packet* request)
+{
+	int count = (request->packet_type & PT_IS_BATCH) ? (request->packet_type >> 2) & 0x0F : 1;
+
+	stats.requests++;
+
+	if (request->address >= GET_FW_REVISION)
+	{
+		switch (request->address)
+		{
+			case GET_FW_REVISION:
+				memcpy(registers[GET_FW_REVISION], SIM_FW_REVISION, 4);
+				send_packet(PT_HAS_DATA, GET_FW_REVISION, 1);
+				break;
+			case RESET_TO_FACTORY:
+				factory_defaults();
+				send_packet(0, request->address, 0);
+				break;
+			case FLASH_COMMIT:
+			case ZERO_GYROS:
+			case SET_HOME_POSITION:
+			case SET_MAG_REFERENCE:
+			case RESET_EKF:
+				send_packet(0, request->address, 0);
+				break;
+			default:
+				//unknown command
+				send_packet(PT_CF, request->address, 0);
+				break;
+		}
+
+		return;
+	}
+
+	if (request->packet_type & PT_HAS_DATA)
+	{
+		//register write, acknowledged with an empty packet
+		for (int i = 0; i < count && request->address + i < 256; i++)
+		{
+			memcpy(registers[request->address + i], &request->data[4*i], 4);
+		}
+
+		update_rates();
+		send_packet(0, request->address, 0);
+	}
+	else
+	{
+		//register read, answered with the register contents
+		send_packet(PT_HAS_DATA | ((count > 1) ? PT_IS_BATCH | (count << 2) : 0), request->address, count);
+	}
+}
+
+
+static double chance(void)
+{
+	return rand()/(RAND_MAX + 1.0);
+}
+
+
+//USB serial adapters hold received bytes until their latency timer runs 
+//out, with -j the simulated link does the same
+static int link_write(const uint8_t* bytes, int n)
+{
+	if (latency_ms == 0)
+	{
+		return write(master_fd, bytes, n) == n;
+	}
+
+	if (link_pending + n > sizeof(link_buffer))
+	{
+		return 0;
+	}
+
+	memcpy(&link_buffer[link_pending], bytes, n);
+	link_pending += n;
+
+	return 1;
+}
+
+
+void link_flush(void)
+{
+	if (link_pending && write(master_fd, link_buffer, link_pending) != link_pending)
+	{
+		stats.overflows++;
+		uart_overflow = 1;
+	}
+
+	link_pending = 0;
+}
+
+
+void send_packet(uint8_t packet_type, uint8_t address, uint8_t count)
+{
+	static uint64_t start = 0;
+	packet tx_packet;
+	uint8_t buffer[MAX_PACKET_LENGTH];
+
+	if (start == 0)
+	{
+		start = hostTime();
+	}
+
+	tx_packet.packet_type = packet_type;
+	tx_packet.address = address;
+	tx_packet.n_data_bytes = (packet_type & PT_HAS_DATA) ? 4*count : 0;
+
+	for (int i = 0; i < count && (packet_type & PT_HAS_DATA); i++)
+	{
+		memcpy(&tx_packet.data[4*i], registers[(uint8_t)(address + i)], 4);
+	}
+
+	int length = encodePacket(&tx_packet, buffer);
+
+	//a real UM7 drops packets and flags an overflow when the link is saturated
+	if (baud_rate > 0 && (stats.bytes_sent + length)*10.0/baud_rate > (hostTime() - start)*1e-9 + 0.01)
+	{
+		stats.overflows++;
+		uart_overflow = 1;
+		return;
+	}
+
+	if (bad_checksum_rate > 0 && chance() < bad_checksum_rate)
+	{
+		buffer[length - 1] ^= 0x5A;
+		stats.bad_checksums++;
+	}
+
+	int n = 0;
+	uint8_t faulty[MAX_PACKET_LENGTH];
+
+	for (int i = 0; i < length; i++)
+	{
+		if (drop_rate > 0 && chance() < drop_rate)
+		{
+			stats.dropped_bytes++;
+			continue;
+		}
+
+		faulty[n] = buffer[i];
+
+		if (bit_error_rate > 0 && chance() < 8*bit_error_rate)
+		{
+			faulty[n] ^= 1 << (rand() % 8);
+			stats.bit_errors++;
+		}
+
+		n++;
+	}
+
+	if (!link_write(faulty, n))
+	{
+		//the client is not keeping up and the pty buffer is full
+		stats.overflows++;
+		uart_overflow = 1;
+		return;
+	}
+
+	if (address == DREG_HEALTH)
+	{
+		uart_overflow = 0;
+	}
+
+	stats.packets_sent++;
+	stats.bytes_sent += length;
+}
+
+
+void print_stats(void)
+{
+	cprint("[**] ", BRIGHT, CYAN);
+	printf("sent %llu packets (%llu bytes), %llu requests, %llu overflows, %llu bit errors, %llu dropped bytes, %llu bad checksums\n",
+		(unsigned long long)stats.packets_sent, (unsigned long long)stats.bytes_sent, (unsigned long long)stats.requests,
+		(unsigned long long)stats.overflows, (unsigned long long)stats.bit_errors, (unsigned long long)stats.dropped_bytes,
+		(unsigned long long)stats.bad_checksums);
+	fflush(stdout);
+}
+
+
+void stop(int signal)
+{
+	is_running = 0;
+}
+
+
+//sets a group rate from 'name=hz'
+static void set_rate(char* setting)
+{
+	char* value = strchr(setting, '=');
+
+	if (value)
+	{
+		*value++ = '\0';
+
+		for (int i = 0; i < SIM_MAX_GROUPS; i++)
+		{
+			if (strcmp(groups[i].name, setting) == 0)
+			{
+				groups[i].rate = atof(value);
+				groups[i].is_fixed = 1;
+				return;
+			}
+		}
+	}
+
+	fprintf(stderr, "Unknown broadcast group '%s'.\n", setting);
+	exit(EXIT_FAILURE);
+}
+
+
+void help(void)
+{
+	printf("um7rp-sim: UM7 simulator on a pseudo-terminal\n");
+	printf("usage: um7rp-sim [options]\n");
+	printf(" -l: create a symlink to the pty, e.g. /tmp/um7\n");
+	printf(" -r: fix a broadcast rate in Hz, e.g. -r all_proc=500 -r health=1\n");
+	printf("     groups: health temperature all_proc gyro accel mag quat euler position velocity gps\n");
+	printf(" -b: simulated link baud rate, packets beyond it are dropped (default unlimited)\n");
+	printf(" -e: bit error rate\n");
+	printf(" -x: byte drop rate\n");
+	printf(" -c: bad checksum rate per packet\n");
+	printf(" -d: device clock error in ppm\n");
+	printf(" -j: USB adapter latency timer in ms, bytes are held and sent in bursts\n");
+	printf(" -g: lose GPS for this many seconds after every this many seconds with it\n");
+	printf(" -s: random seed\n");
+	printf(" -v: print statistics every second\n");
+	exit(EXIT_SUCCESS);
+}
+
+
+void parse_options(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:r:b:e:x:c:d:j:g:s:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'l':
+				link_path = optarg;
+				break;
+			case 'r':
+				set_rate(optarg);
+				break;
+			case 'b':
+				baud_rate = atoi(optarg);
+				break;
+			case 'e':
+				bit_error_rate = atof(optarg);
+				break;
+			case 'x':
+				drop_rate = atof(optarg);
+				break;
+			case 'c':
+				bad_checksum_rate = atof(optarg);
+				break;
+			case 'd':
+				clock_drift = atof(optarg);
+				break;
+			case 'j':
+				latency_ms = atoi(optarg);
+				break;
+			case 'g':
+				gps_outage = atof(optarg);
+				break;
+			case 's':
+				srand(atoi(optarg));
+				break;
+			case 'v':
+				is_verbose = 1;
+				break;
+			default:
+				help();
+		}
+	}
+}
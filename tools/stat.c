@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "metrics.h"
+#include "histogram.h"
+#include "clock.h"
+
+void help(void);
+void print_latency(const char* name, const latency_histogram* h);
+void print_device(int index, const device_metrics* m, const device_metrics* last, double seconds);
+
+int main(int argc, char *argv[])
+{
+	double interval = 1;
+	int count = 0;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "i:n:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'i':
+				interval = atof(optarg);
+				break;
+			case 'n':
+				count = atoi(optarg);
+				break;
+			default:
+				help();
+		}
+	}
+	
+	const metrics_page* page = openMetrics();
+	
+	if (!page)
+	{
+		fprintf(stderr, "No running um7rp found (%s).\n", METRICS_SHM_NAME);
+		return EXIT_FAILURE;
+	}
+	
+	//the counters only ever grow, the difference between two copies gives 
+	//the rates over the interval
+	device_metrics last[METRICS_MAX_DEVICES];
+	uint64_t last_time = hostTime();
+	
+	memcpy(last, page->devices, sizeof(last));
+	
+	for (int i = 0; count == 0 || i < count; i++)
+	{
+		usleep(interval*1e6);
+		
+		if (kill(page->pid, 0) != 0)
+		{
+			fprintf(stderr, "um7rp (pid %i) has exited.\n", page->pid);
+			return EXIT_FAILURE;
+		}
+		
+		uint64_t now = hostTime();
+		double seconds = (now - last_time)*1e-9;
+		
+		printf("um7rp pid %i, up %.0f s\n", page->pid, (now - page->start_time)*1e-9);
+		
+		for (int k = 0; k < page->n_devices && k < METRICS_MAX_DEVICES; k++)
+		{
+			print_device(k, &page->devices[k], &last[k], seconds);
+		}
+		
+		printf("\n");
+		fflush(stdout);
+		
+		memcpy(last, page->devices, sizeof(last));
+		last_time = now;
+	}
+	
+	return EXIT_SUCCESS;
+}
+
+
+void print_latency(const char* name, const latency_histogram* h)
+{
+	printf("  %-18s p50 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f us  (%llu)\n", name, 
+		histogramPercentile(h, 50)*1e-3, histogramPercentile(h, 99)*1e-3, histogramPercentile(h, 99.9)*1e-3, 
+		histogramPercentile(h, 100)*1e-3, (unsigned long long)readCounter(&h->count));
+}
+
+
+void print_device(int index, const device_metrics* m, const device_metrics* last, double seconds)
+{
+	uint64_t packets = readCounter(&m->packets);
+	uint64_t bytes = readCounter(&m->bytes);
+	
+	printf("IMU %i\n", index);
+	printf("  read:    %12llu packets %12llu bytes %10llu reads  %8.1f packets/s %10.0f B/s\n", (unsigned long long)packets, 
+		(unsigned long long)bytes, (unsigned long long)readCounter(&m->reads), (packets - last->packets)/seconds, (bytes - last->bytes)/seconds);
+	printf("  parser:  %12llu checksum errors %5llu skipped bytes %5llu dropped bytes %5llu address mismatches\n", 
+		(unsigned long long)readCounter(&m->checksum_errors), (unsigned long long)readCounter(&m->skipped_bytes), 
+		(unsigned long long)readCounter(&m->dropped_bytes), (unsigned long long)readCounter(&m->address_mismatches));
+	printf("  queue:   %12llu deep, high water %llu, %llu dropped, %llu logged, %llu write errors\n", (unsigned long long)readCounter(&m->queue_depth), 
+		(unsigned long long)readCounter(&m->queue_high_water), (unsigned long long)readCounter(&m->queue_dropped), 
+		(unsigned long long)readCounter(&m->logged_packets), (unsigned long long)readCounter(&m->log_write_errors));
+	print_latency("arrival to decode", &m->arrival_to_decode);
+	print_latency("decode to disk", &m->decode_to_disk);
+	print_latency("block write", &m->log_write);
+	print_latency("sync", &m->log_sync);
+}
+
+
+void help(void)
+{
+	printf("usage: um7rp-stat [-i interval] [-n count]\n");
+	printf(" -i: seconds between reports (default 1)\n");
+	printf(" -n: reports to print, 0 runs until interrupted (default 0)\n");
+	printf("\nreads the counters a running um7rp publishes in %s without\n", METRICS_SHM_NAME);
+	printf("touching its threads.\n");
+	exit(EXIT_SUCCESS);
+}
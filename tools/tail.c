@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "shmring.h"
+#include "histogram.h"
+#include "clock.h"
+
+void help(void);
+void print_sample(const ring_sample* sample, uint64_t received);
+void print_summary(const ring_reader* reader, uint64_t samples, const latency_histogram* delivery, const latency_histogram* arrival);
+
+int main(int argc, char *argv[])
+{
+	long count = 0;
+	int device = -1;
+	int is_oldest = 0;
+	int is_quiet = 0;
+	int is_spinning = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:oqsh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n':
+				count = atol(optarg);
+				break;
+			case 'd':
+				device = atoi(optarg);
+				break;
+			case 'o':
+				is_oldest = 1;
+				break;
+			case 'q':
+				is_quiet = 1;
+				break;
+			case 's':
+				is_spinning = 1;
+				break;
+			default:
+				help();
+		}
+	}
+
+	sample_ring* ring = openRing();
+
+	if (!ring)
+	{
+		fprintf(stderr, "No running um7rp found (%s).\n", SHMRING_NAME);
+		return EXIT_FAILURE;
+	}
+
+	ring_reader reader;
+	ring_sample sample;
+	latency_histogram delivery, arrival;
+	uint64_t samples = 0;
+	uint64_t last_report = hostTime();
+
+	initRingReader(&reader, ring, is_oldest);
+	initHistogram(&delivery);
+	initHistogram(&arrival);
+
+	while (count == 0 || samples < count)
+	{
+		int is_read = is_spinning ? readSample(&reader, &sample) : waitSample(&reader, &sample, 1000);
+		uint64_t now = hostTime();
+
+		if (is_read && (device < 0 || sample.device == device))
+		{
+			//publish to here is the ring itself, arrival adds the parser and decode
+			recordHistogram(&delivery, now - sample.decoded);
+			recordHistogram(&arrival, now - sample.timestamp);
+			samples++;
+
+			if (!is_quiet)
+			{
+				print_sample(&sample, now);
+			}
+		}
+
+		if (is_quiet && now - last_report >= 1000000000ULL)
+		{
+			print_summary(&reader, samples, &delivery, &arrival);
+			last_report = now;
+		}
+
+		if (!is_read && kill(ring->pid, 0) != 0)
+		{
+			fprintf(stderr, "um7rp (pid %i) has exited.\n", ring->pid);
+			break;
+		}
+	}
+
+	print_summary(&reader, samples, &delivery, &arrival);
+	closeRing(ring);
+
+	return EXIT_SUCCESS;
+}
+
+
+void print_sample(const ring_sample* sample, uint64_t received)
+{
+	const imu_state* state = &sample->state;
+
+	printf("%llu %u %.6f 0x%03X", (unsigned long long)sample->index, sample->device, sample->timestamp*1e-9, sample->updated);
+
+	if (sample->updated & DECODED_GYRO)
+		printf(" gyro %f %f %f", state->gyro.x, state->gyro.y, state->gyro.z);
+	if (sample->updated & DECODED_ACCEL)
+		printf(" accel %f %f %f", state->accel.x, state->accel.y, state->accel.z);
+	if (sample->updated & DECODED_QUAT)
+		printf(" quat %f %f %f %f", state->quat.a, state->quat.b, state->quat.c, state->quat.d);
+	if (sample->updated & DECODED_EULER)
+		printf(" euler %f %f %f", state->euler.roll, state->euler.pitch, state->euler.yaw);
+	if (sample->updated & DECODED_GPS)
+		printf(" gps %f %f %f", state->gps.latitude, state->gps.longitude, state->gps.altitude);
+
+	printf(" (%.1f us)\n", (received - sample->decoded)*1e-3);
+}
+
+
+void print_summary(const ring_reader* reader, uint64_t samples, const latency_histogram* delivery, const latency_histogram* arrival)
+{
+	fprintf(stderr, "%llu samples, %llu lost. Publish to read: p50 %.1f, p99 %.1f, max %.1f us. Arrival to read: p50 %.1f, p99 %.1f, max %.1f us.\n",
+		(unsigned long long)samples, (unsigned long long)reader->lost,
+		histogramPercentile(delivery, 50)*1e-3, histogramPercentile(delivery, 99)*1e-3, histogramPercentile(delivery, 100)*1e-3,
+		histogramPercentile(arrival, 50)*1e-3, histogramPercentile(arrival, 99)*1e-3, histogramPercentile(arrival, 100)*1e-3);
+}
+
+
+void help(void)
+{
+	printf("usage: um7rp-tail [-n samples] [-d device] [-o] [-q] [-s]\n");
+	printf(" -n: samples to read, 0 runs until um7rp exits (default 0)\n");
+	printf(" -d: only samples of this device\n");
+	printf(" -o: start at the oldest sample still in the ring, not the next one\n");
+	printf(" -q: no samples, a latency summary every second\n");
+	printf(" -s: spin on the ring instead of sleeping until um7rp publishes\n");
+	printf("\nfollows the samples a running um7rp publishes in %s. Samples\n", SHMRING_NAME);
+	printf("overwritten before they were read are counted as lost.\n");
+	printf("\nthe ring must be writable by this user, a um7rp running as root sets\n");
+	printf("its permissions with -A (default %04o).\n", SHMRING_MODE);
+	exit(EXIT_SUCCESS);
+}
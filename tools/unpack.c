@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "logread.h"
+#include "clock.h"
+
+void help(void);
+
+int main(int argc, char *argv[])
+{
+	char* out_path = NULL;
+	int opt;
+	
+	while ((opt = getopt(argc, argv, "o:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'o':
+				out_path = optarg;
+				break;
+			default:
+				help();
+		}
+	}
+	
+	if (optind >= argc || !out_path)
+	{
+		help();
+	}
+	
+	int fd = open(argv[optind], O_RDONLY);
+	struct stat packed_stat;
+	
+	if (fd < 0 || fstat(fd, &packed_stat))
+	{
+		fprintf(stderr, "Could not open %s.\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	
+	const uint8_t* packed = mmap(NULL, packed_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	
+	if (packed == MAP_FAILED)
+	{
+		fprintf(stderr, "Could not map %s.\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	
+	//fault the file in first so the time is the decoder's, not the disk's
+	volatile uint8_t sum = 0;
+	
+	for (off_t i = 0; i < packed_stat.st_size; i += 4096)
+	{
+		sum += packed[i];
+	}
+	
+	uint8_t* plain;
+	uint32_t corrupt_blocks = 0;
+	uint64_t start = hostTime();
+	uint64_t plain_size = unpackLog(packed, packed_stat.st_size, &plain, &corrupt_blocks);
+	double seconds = (hostTime() - start)*1e-9;
+	
+	if (plain_size == 0)
+	{
+		fprintf(stderr, "%s is not a packed log, or there is not the memory to unpack it.\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	
+	FILE* out = fopen(out_path, "wb");
+	
+	if (!out || fwrite(plain, 1, plain_size, out) != plain_size)
+	{
+		fprintf(stderr, "Could not write %s.\n", out_path);
+		return EXIT_FAILURE;
+	}
+	
+	fclose(out);
+	
+	printf("%llu bytes unpacked to %llu (%.2fx) in %.3f ms, %.0f MB/s.\n", (unsigned long long)packed_stat.st_size, (unsigned long long)plain_size, 
+		(double)plain_size/packed_stat.st_size, seconds*1e3, plain_size/seconds*1e-6);
+	
+	if (corrupt_blocks)
+	{
+		fprintf(stderr, "Skipped %u damaged blocks.\n", corrupt_blocks);
+	}
+	
+	free(plain);
+	munmap((void*)packed, packed_stat.st_size);
+	close(fd);
+	
+	return EXIT_SUCCESS;
+}
+
+
+void help(void)
+{
+	printf("usage: um7rp-unpack -o imu.log imu.lz\n");
+	printf(" -o: plain log to write\n");
+	printf("\num7rp-log reads packed logs directly, this is for other tools.\n");
+	exit(EXIT_SUCCESS);
+}